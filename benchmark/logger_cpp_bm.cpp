@@ -0,0 +1,11 @@
+#include "logger.hpp"
+
+static const int kLoggingCount = 1000000;
+
+int main(void) {
+    logger_initFileLogger("logs/logger_cpp.txt", 1024 * 1024 * 30, 3);
+    for (int i = 0; i < kLoggingCount; i++) {
+        LOGGER_INFO("%d", i);
+    }
+    return 0;
+}
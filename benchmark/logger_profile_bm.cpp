@@ -0,0 +1,31 @@
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+#include "logger.h"
+
+static const int kLoggingCount = 1000000;
+
+int main(int argc, char** argv) {
+    int nThreads = 1;
+    if (argc > 1) {
+        nThreads = atoi(argv[1]);
+    }
+
+    logger_initFileLogger("logs/logger_profile.txt", 1024 * 1024 * 30, 3);
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < nThreads; i++) {
+        threads.push_back(std::thread([=]() {
+            for (int j = i; j < kLoggingCount; j += nThreads) {
+                LOG_INFO("%d", j);
+            }
+        }));
+    }
+    for (std::thread& th : threads) {
+        th.join();
+    }
+    logger_flush();
+    logger_dumpProfile(stdout);
+    return 0;
+}
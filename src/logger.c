@@ -1,3 +1,6 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+ #define _GNU_SOURCE
+#endif /* defined(__linux__) && !defined(_GNU_SOURCE) */
 #include "logger.h"
 #include <assert.h>
 #include <stdarg.h>
@@ -5,374 +8,4213 @@
 #include <time.h>
 #if defined(_WIN32) || defined(_WIN64)
  #include <winsock2.h>
+ #include <intrin.h>
+ #include <io.h>
 #else
+ #include <errno.h>
+ #include <fcntl.h>
+ #include <fnmatch.h>
  #include <pthread.h>
+ #include <sys/mman.h>
+ #include <sys/socket.h>
+ #include <sys/stat.h>
  #include <sys/time.h>
  #include <sys/syscall.h>
+ #include <sys/un.h>
  #include <unistd.h>
 #endif /* defined(_WIN32) || defined(_WIN64) */
 
+#if defined(_MSC_VER)
+ #define THREAD_LOCAL __declspec(thread)
+#else
+ #define THREAD_LOCAL __thread
+#endif /* defined(_MSC_VER) */
+
+/* Settings written under the lock and read without it while logging */
+#if defined(__GNUC__)
+ #define loadRelaxed(p) __atomic_load_n(p, __ATOMIC_RELAXED)
+ #define storeRelaxed(p, v) __atomic_store_n(p, v, __ATOMIC_RELAXED)
+ #define loadAcquire(p) __atomic_load_n(p, __ATOMIC_ACQUIRE)
+ #define storeRelease(p, v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#else
+ #define loadRelaxed(p) (*(p))
+ #define storeRelaxed(p, v) (*(p) = (v))
+ #define loadAcquire(p) (*(p))
+ #define storeRelease(p, v) (*(p) = (v))
+#endif /* defined(__GNUC__) */
+
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+ #define HAVE_TSC 1
+ #define readTSC() __rdtsc()
+#elif defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+ #define HAVE_TSC 1
+ #define readTSC() __builtin_ia32_rdtsc()
+#endif
+
+#if defined(__linux__) && defined(O_DIRECT) && defined(__GLIBC__)
+ #define HAVE_DIRECT_IO 1
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+ #define HAVE_SSE2 1
+ #include <emmintrin.h>
+#endif
+#if defined(HAVE_SSE2) && defined(__GNUC__) && (__GNUC__ >= 5 || defined(__clang__))
+ #define HAVE_AVX2 1 /* compiled for the functions using it, selected at runtime */
+ #include <immintrin.h>
+#endif
+
 enum {
     /* Logger type */
     kConsoleLogger = 1 << 0,
     kFileLogger = 1 << 1,
+    kSocketLogger = 1 << 2,
 
     kMaxFileNameLen = 255, /* without null character */
+    kMaxThreadFileNameLen = kMaxFileNameLen + 22, /* <filename>.t<thread ID> */
     kDefaultMaxFileSize = 1048576L, /* 1 MB */
+    kClockCalibrationTime = 20, /* msec */
+    kLineBufferSize = 1024, /* lines longer than this are rendered on the heap */
+    kMaxLongLineSize = 65536, /* longer lines are allocated at every call */
+    kMinBatchSize = 4096, /* bytes, smaller batches are written line by line */
+    kMaxBatchSize = 262144,
+    kBurstInterval = 100, /* usec between lines arriving in a burst */
+    kMaxBatchDelay = 10000, /* usec a line waits in a batch */
+    kSyncInterval = 1000, /* msec between syncs with LogFileOption_SYNC_PERIODIC */
+    kHexDumpRowSize = 16, /* bytes per line of a hex dump */
+    kMaxHexDumpSize = 4096, /* bytes dumped by logger_logHex() */
+    kMaxSocketPathLen = 107, /* without null character */
+    kSocketBatchSize = 16384, /* bytes per datagram */
+    kSocketBufferSize = 262144, /* bytes kept while the collector is unreachable */
+    kSocketRetryInterval = 1000, /* msec */
+    kSharedFileBufferSize = 65536, /* lines up to this size are written with one write(2) */
+    kThreadFileBufferSize = 65536,
+    kDirectBlockSize = 4096, /* O_DIRECT alignment of buffers, offsets and lengths */
+    kDirectBufferSize = 262144, /* bytes written per O_DIRECT write */
+    kMaxPatternLen = 255, /* literal characters of a format */
+    kMaxPatternOps = 64,
+    kMaxPrefixLen = 512, /* the fields before the message */
+    kMaxSuffixLen = 256, /* the fields after the message */
+    kNoThreadLevel = -1, /* the thread follows logger_setLevel() */
+    kConsoleBufferSize = 262144, /* bytes waiting for the console writer */
+    kConsoleBatchSize = 16384, /* bytes written at once to a pipe or file */
+    kConsoleFlushInterval = 100, /* msec lines wait to be written to a pipe or file */
+    kMaxContextLen = 256, /* the rendered context of a thread */
+    kMaxContextDepth = 16,
+    kRetentionInterval = 60, /* sec between checks of the backup ages */
+    kMaxDiscardedFiles = 64, /* removed files waiting for their blocks to be released */
+};
+
+/* Stage of logging timed with LOGGER_PROFILE */
+enum {
+    kStageClock, /* reading and converting the clock */
+    kStageThread, /* getting the thread ID */
+    kStagePrefix, /* rendering the fields around the message */
+    kStageMessage, /* formatting the message */
+    kStageLock, /* waiting for the logger lock */
+    kStageRotate, /* checking and rotating the file */
+    kStageWrite, /* writing the line to the file buffer */
+    kStageFlush, /* flushing the file */
+    kStageSync, /* syncing the file to the disk */
+    kStageTotal, /* the whole logging call */
+    kStages,
+    kProfileBuckets = 31, /* powers of two of cycles, the last one taking the rest */
+};
+
+/* Line buffer of a thread */
+enum {
+    kLongLine,
+    kEscapedLine,
+    kLineBuffers,
+};
+
+/* Timestamp style */
+enum {
+    kTimestampDefault, /* yy-MM-dd hh:mm:ss.uuuuuu */
+    kTimestampISO8601, /* yyyy-MM-ddThh:mm:ss.uuuuuu+hh:mm */
+    kTimestampUTC, /* yyyy-MM-ddThh:mm:ss.uuuuuuZ */
+    kTimestampStyles,
 };
 
+/* Operation of a compiled format */
+enum {
+    kOpLiteral,
+    kOpLevel, /* %L */
+    kOpLevelName, /* %V */
+    kOpDate, /* %D, %D{iso8601} or %D{utc} */
+    kOpThread, /* %t */
+    kOpFile, /* %f */
+    kOpLine, /* %l */
+    kOpMessage, /* %m */
+    kOpContext, /* %X */
+    kOpDefaultPrefix, /* "%L %D %t %f:%l: " in one operation */
+    kOpPrefixContext, /* the context and a space, if any, after the default prefix */
+};
+
+/* Precomputed escape sequences coloring the lines of each level on a terminal */
+static const char* const kLevelColors[] = {
+    "\033[90m", "\033[36m", "\033[32m", "\033[33m", "\033[31m", "\033[1;31m",
+};
+static const size_t kLevelColorLens[] = { 5, 5, 5, 5, 5, 7 };
+static const char kColorReset[] = "\033[0m\n";
+
+/* The two hex digits of every byte */
+static const char kHexPairs[] =
+    "000102030405060708090a0b0c0d0e0f" "101112131415161718191a1b1c1d1e1f"
+    "202122232425262728292a2b2c2d2e2f" "303132333435363738393a3b3c3d3e3f"
+    "404142434445464748494a4b4c4d4e4f" "505152535455565758595a5b5c5d5e5f"
+    "606162636465666768696a6b6c6d6e6f" "707172737475767778797a7b7c7d7e7f"
+    "808182838485868788898a8b8c8d8e8f" "909192939495969798999a9b9c9d9e9f"
+    "a0a1a2a3a4a5a6a7a8a9aaabacadaeaf" "b0b1b2b3b4b5b6b7b8b9babbbcbdbebf"
+    "c0c1c2c3c4c5c6c7c8c9cacbcccdcecf" "d0d1d2d3d4d5d6d7d8d9dadbdcdddedf"
+    "e0e1e2e3e4e5e6e7e8e9eaebecedeeef" "f0f1f2f3f4f5f6f7f8f9fafbfcfdfeff";
+
+static const char kDefaultFormat[] = "%L %D %t %f:%l: %m";
+static const char kDefaultPrefix[] = "%L %D %t %f:%l: ";
+
+enum {
+    kSharedFileMagic = 0x4c4f4731, /* "LOG1" */
+};
+
+static const char kIndexMagic[] = "LOGIDX01"; /* the header of <filename>.idx */
+static const char kIndexSuffix[] = ".idx";
+
+/* File logger state shared by the processes logging to the same file */
+typedef struct {
+    volatile unsigned int magic;
+    volatile long fileSize;
+    volatile unsigned long generation; /* incremented at every rotation */
+} SharedFileState;
+
+/* A file written with O_DIRECT from a block aligned buffer */
+typedef struct {
+    int fd;
+    char* buffer; /* starts at the block containing the end of the file */
+    size_t used;
+    long long offset; /* file offset of buffer */
+} DirectFile;
+
+/* An entry of the sparse time index <filename>.idx following kIndexMagic */
+typedef struct {
+    unsigned long long time; /* microseconds since the epoch */
+    unsigned long long offset; /* of the first line logged at or after time */
+} IndexEntry;
+
+typedef struct {
+    int type;
+    int style; /* of kOpDate */
+    size_t offset, len; /* of kOpLiteral in literals */
+} PatternOp;
+
+/* A format compiled by logger_setFormat(). It is not changed once published. */
+typedef struct Pattern {
+    PatternOp ops[kMaxPatternOps];
+    size_t nops;
+    size_t messageOp; /* the index of %m splitting the prefix and the suffix */
+    int dateStyle; /* of the first %D, used in the repeat summary */
+    char literals[kMaxPatternLen];
+    size_t literalsLen;
+    struct Pattern* next; /* in s_patterns */
+} Pattern;
+
+/* A point in wall-clock time */
+typedef struct {
+    time_t sec;
+    long nsec;
+} LogTime;
+
+/* A log line rendered once and written to every logger */
+typedef struct {
+    LogLevel level;
+    const char* file;
+    int line;
+    long threadID;
+    const char* context; /* "key=value key=value" */
+    size_t contextlen;
+    LogTime time;
+    unsigned long long currentTime; /* milliseconds */
+    unsigned long long hash; /* identifies level, call site and message */
+    int kept; /* below the level, let through by logger_keepContext() */
+    const char* text; /* the whole line including LF */
+    size_t len;
+    char suffix[kMaxSuffixLen]; /* the fields following the message */
+    size_t suffixlen;
+} LogRecord;
+
+/* The context pushed by logger_pushContext(), kept rendered */
+typedef struct {
+    char text[kMaxContextLen]; /* "key=value key=value" */
+    size_t len;
+    size_t ends[kMaxContextDepth]; /* the length of the text before each entry */
+    int depth; /* including the entries that did not fit */
+} Context;
+
+/* The header of a line kept by logger_keepContext(), followed by its text */
+typedef struct {
+    LogLevel level;
+    const char* file;
+    int line;
+    unsigned long long hash;
+    LogTime time;
+    size_t len;
+} KeptLine;
+
+/* Collapses consecutive duplicate lines into one summary line */
+typedef struct {
+    int enabled;
+    unsigned long long hash;
+    LogLevel level;
+    const char* file;
+    int line;
+    long threadID;
+    long count; /* suppressed repeats */
+    LogTime first, last;
+} Dedup;
+
+/* A file owned by one thread with LogFileOption_PER_THREAD */
+typedef struct ThreadFile {
+    FILE* output;
+    int fd; /* of output, to sync it */
+    char filename[kMaxThreadFileNameLen + 1];
+    long maxFileSize;
+    unsigned char maxBackupFiles;
+    long currentFileSize;
+    unsigned long long flushedTime;
+    unsigned long long syncedTime;
+    Dedup dedup;
+    unsigned long generation; /* the file logger configuration output was opened with */
+    struct ThreadFile* next;
+} ThreadFile;
+
+typedef struct Logger Logger;
+
 /* Console logger */
-static struct {
+typedef struct {
     FILE* output;
     unsigned long long flushedTime;
-} s_clog;
+    Dedup dedup;
+    int colored; /* LogConsoleOption_COLOR on a terminal */
+    int terminal;
+    int async; /* the writer thread is running */
+#if !defined(_WIN32) && !defined(_WIN64)
+    pthread_t writer;
+    pthread_mutex_t mutex; /* guards the buffers, not held while writing */
+    pthread_cond_t ready; /* lines to write */
+    pthread_cond_t drained; /* the lines have been written */
+    char* buffers[2]; /* one filled by the loggers while the writer writes the other */
+    char* buffer;
+    size_t used;
+    int writing;
+    int flushing; /* threads waiting for the lines to be written */
+    int urgent; /* a line to write without waiting for the batch */
+    int stopping;
+#endif /* !defined(_WIN32) && !defined(_WIN64) */
+    unsigned long long droppedLines;
+} ConsoleLogger;
 
 /* File logger */
-static struct {
+typedef struct {
     FILE* output;
+    int fd; /* of output, to sync it */
     char filename[kMaxFileNameLen + 1];
     long maxFileSize;
     unsigned char maxBackupFiles;
     long currentFileSize;
     unsigned long long flushedTime;
-} s_flog;
+    Dedup dedup;
+    int options;
+    SharedFileState* shared; /* mapped from <filename>.lock with LogFileOption_SHARED */
+    int sharedfd;
+    unsigned long generation; /* the rotation generation of output */
+    FILE* index; /* <filename>.idx */
+    long indexInterval; /* bytes between index entries, 0 is index off */
+    long indexedSize; /* the file size to write the next index entry at */
+    volatile unsigned long threadGeneration; /* incremented when thread files must reopen */
+    ThreadFile* threadFiles; /* opened with LogFileOption_PER_THREAD */
+    long batchSize; /* bytes written at once with LogFileOption_ADAPTIVE */
+    long batched; /* bytes buffered since the last write */
+    unsigned long long batchTime; /* usec the batch started */
+    unsigned long long lastTime; /* usec of the last line */
+    unsigned long long written; /* writes to output, numbered to tell which are synced */
+    unsigned long long synced; /* the writes synced to the disk */
+    unsigned long long syncedTime; /* msec of the last sync */
+    unsigned long long syncs;
+#if !defined(_WIN32) && !defined(_WIN64)
+    int flushing; /* the flusher thread is running */
+    int stopping;
+    pthread_t flusher;
+    pthread_cond_t batchStarted;
+    int syncing; /* a thread is syncing the file outside the lock */
+    pthread_cond_t fileSynced;
+#endif /* !defined(_WIN32) && !defined(_WIN64) */
+} FileLogger;
+
+/* Retention of the backups by total size and age */
+typedef struct {
+    unsigned long long maxTotalSize; /* bytes of the backups, 0 is no limit */
+    long maxAge; /* sec since the last line of a backup, 0 is no limit */
+    unsigned long rotations; /* of the file logger, the backups shift at each */
+#if !defined(_WIN32) && !defined(_WIN64)
+    int running; /* the retention thread */
+    int stopping;
+    int pending; /* the backups are to be checked */
+    pthread_t thread;
+    pthread_cond_t wakeup;
+    int discarded[kMaxDiscardedFiles]; /* descriptors of removed files, closed by the thread */
+    int ndiscarded;
+#endif /* !defined(_WIN32) && !defined(_WIN64) */
+} Retention;
+
+/* Socket logger */
+typedef struct {
+    int fd;
+    int connected;
+    int hasConnected;
+    char path[kMaxSocketPathLen + 1];
+    LogSocketType type;
+    char* buffer; /* whole lines waiting to be sent */
+    size_t used;
+    int partial; /* the front line has been partially sent on a stream */
+    unsigned long long flushedTime;
+    unsigned long long retryTime;
+    unsigned long long sentBytes;
+    unsigned long long droppedLines;
+    unsigned long long reconnects;
+    Dedup dedup;
+} SocketLogger;
+
+/* A logger with its own loggers, level and lock. The functions without one act on s_default. */
+struct Logger {
+    volatile LogLevel level;
+    volatile int loggers;
+#if defined(_WIN32) || defined(_WIN64)
+    CRITICAL_SECTION mutex;
+#else
+    pthread_mutex_t mutex;
+#endif /* defined(_WIN32) || defined(_WIN64) */
+    ConsoleLogger clog;
+    FileLogger flog;
+    SocketLogger slog;
+    Retention retention;
+    struct Logger* next; /* in s_instances */
+};
+
+/* Timestamp clock: wall nanoseconds = baseNanos + (ticks - baseTicks) * nanosPerTick.
+   A clock is not changed once published; logger_setClock() publishes another one. */
+typedef struct ClockState {
+    LogClock type;
+    unsigned long long baseTicks;
+    unsigned long long baseNanos;
+    double nanosPerTick;
+    struct ClockState* next; /* in s_clocks */
+} ClockState;
+
+static ClockState s_realtimeClock = { LogClock_REALTIME, 0, 0, 1.0, NULL };
+static ClockState* s_clock = &s_realtimeClock;
+static ClockState* s_clocks; /* replaced clocks, kept for the threads still using them */
+
+/* The ID of this thread, cached to save a system call per message */
+static THREAD_LOCAL long s_threadID;
+
+/* The level set by logger_setThreadLevel() for this thread, or kNoThreadLevel */
+static THREAD_LOCAL int s_threadLevel = kNoThreadLevel;
+
+/* The context of this thread */
+static THREAD_LOCAL Context s_context;
+
+#if !defined(_WIN32) && !defined(_WIN64)
+/* The buffers of this thread rendering lines longer than kLineBufferSize and escaping lines */
+static THREAD_LOCAL struct {
+    char* data;
+    size_t size;
+} s_lineBuffers[kLineBuffers];
+#endif /* !defined(_WIN32) && !defined(_WIN64) */
+
+/* The file of this thread with LogFileOption_PER_THREAD */
+static THREAD_LOCAL ThreadFile* s_threadFile;
+
+/* The ring of the lines kept on this thread for its next error, oldest first from start */
+static THREAD_LOCAL struct {
+    char* data;
+    size_t size;
+    size_t start;
+    size_t used;
+} s_keptLines;
+
+#if defined(LOGGER_PROFILE)
+/* Histograms of the cycles each stage took on a thread */
+typedef struct Profile {
+    unsigned long long counts[kStages][kProfileBuckets];
+    unsigned long long cycles[kStages];
+    struct Profile* next;
+} Profile;
 
-static volatile int s_logger;
-static volatile LogLevel s_logLevel = LogLevel_INFO;
+static THREAD_LOCAL Profile* s_profile;
+static Profile* s_profiles; /* of the running threads */
+static Profile s_exitedProfile; /* added up from the exited threads */
+ #define PROFILE_DECLARE(t) unsigned long long t = readCycles();
+ #define PROFILE_RESTART(t) ((t) = readCycles())
+ #define PROFILE(stage, t) profileStage(stage, &(t))
+#else
+ #define PROFILE_DECLARE(t)
+ #define PROFILE_RESTART(t)
+ #define PROFILE(stage, t)
+#endif /* defined(LOGGER_PROFILE) */
+
+/* The last second formatted by formatTimestamp() on this thread in each style */
+static THREAD_LOCAL struct {
+    time_t sec;
+    char text[20]; /* up to the seconds */
+    size_t len;
+    char zone[8]; /* following the fraction */
+    size_t zonelen;
+} s_timestampCache[kTimestampStyles] = { { -1 }, { -1 }, { -1 } };
+
+/* The compiled format in use and the one logger_setFormat() compiles next */
+static Pattern s_defaultPattern;
+static Pattern* s_pattern;
+static Pattern* s_patterns; /* the formats set, kept for the lines still rendered with them */
+
+static Logger s_default = { LogLevel_INFO };
+static Logger* s_instances = &s_default; /* every logger, for the handlers run at exit and fork */
+volatile LogLevel logger_enabledLevel = LogLevel_INFO;
+static int s_threadLevels[LogLevel_FATAL + 1]; /* the number of threads overriding each level */
 static volatile long s_flushInterval = 0; /* msec, 0 is auto flush off */
+static volatile int s_sanitize = 0; /* false */
+static volatile int s_flushLevel = LogLevel_ERROR; /* lines written through at once */
+static volatile int s_syncFlush = 0; /* false, whether they are synced to the disk as well */
+static volatile int s_keepLevel = LogLevel_TRACE; /* the lowest level kept for an error */
+static volatile size_t s_keepSize = 0; /* bytes kept per thread, 0 is off */
 static volatile int s_initialized = 0; /* false */
 #if defined(_WIN32) || defined(_WIN64)
-static CRITICAL_SECTION s_mutex;
+static CRITICAL_SECTION s_instancesMutex;
+#else
+static pthread_mutex_t s_instancesMutex;
+static pthread_key_t s_threadFileKey; /* closes the file of an exiting thread */
+static pthread_key_t s_lineBufferKeys[kLineBuffers]; /* free the line buffers of an exiting thread */
+static pthread_key_t s_profileKey; /* adds up the profile of an exiting thread */
+static pthread_key_t s_keptLinesKey; /* frees the kept lines of an exiting thread */
+static pthread_key_t s_threadLevelKey; /* clears the level of an exiting thread, plus one */
+#endif /* defined(_WIN32) || defined(_WIN64) */
+
+#if defined(LOGGER_HAVE_SITES)
+/* The bounds of the logger_sites section of the LOG_* call sites, set by the linker */
+extern LogSite __start_logger_sites[] __attribute__((weak));
+extern LogSite __stop_logger_sites[] __attribute__((weak));
+#endif /* defined(LOGGER_HAVE_SITES) */
+
+static long writeRepeatSummary(FILE* fp, Dedup* dedup);
+static void sendSocket(Logger* lg, unsigned long long now, int force);
+static void appendSocket(Logger* lg, const char* text, size_t len, unsigned long long now);
+static size_t formatRepeatSummary(Dedup* dedup, char* buf, size_t size);
+static void writeConsoleSummary(Logger* lg);
+static void flushConsole(Logger* lg);
+static void closeThreadFile(void* arg);
+#if !defined(_WIN32) && !defined(_WIN64)
+static void closeProfile(void* arg);
+static void clearThreadLevel(void* arg);
+#endif /* !defined(_WIN32) && !defined(_WIN64) */
+static void flushThreadFiles(Logger* lg);
+static int initConsoleLogger(Logger* lg, FILE* output, int options);
+static int initFileLogger(Logger* lg, const char* filename, long maxFileSize,
+        unsigned char maxBackupFiles, int options);
+static int initSocketLogger(Logger* lg, const char* path, LogSocketType type);
+static void exitSocketLogger(Logger* lg);
+static void flushLogger(Logger* lg);
+static void exitFileLogger(Logger* lg);
+static int compilePattern(const char* format, Pattern* pattern);
+static void updateEnabledLevel(void);
+static void updateSites(void);
+
+/* Initialize the lock and the conditions of a logger */
+static void initLogger(Logger* lg)
+{
+#if defined(_WIN32) || defined(_WIN64)
+    InitializeCriticalSection(&lg->mutex);
+#else
+    pthread_mutex_init(&lg->mutex, NULL);
+    pthread_mutex_init(&lg->clog.mutex, NULL);
+    pthread_cond_init(&lg->clog.ready, NULL);
+    pthread_cond_init(&lg->clog.drained, NULL);
+    pthread_cond_init(&lg->flog.batchStarted, NULL);
+    pthread_cond_init(&lg->flog.fileSynced, NULL);
+    pthread_cond_init(&lg->retention.wakeup, NULL);
+#endif /* defined(_WIN32) || defined(_WIN64) */
+}
+
+static void lockInstances(void)
+{
+#if defined(_WIN32) || defined(_WIN64)
+    EnterCriticalSection(&s_instancesMutex);
+#else
+    pthread_mutex_lock(&s_instancesMutex);
+#endif /* defined(_WIN32) || defined(_WIN64) */
+}
+
+static void unlockInstances(void)
+{
+#if defined(_WIN32) || defined(_WIN64)
+    LeaveCriticalSection(&s_instancesMutex);
 #else
-static pthread_mutex_t s_mutex;
+    pthread_mutex_unlock(&s_instancesMutex);
 #endif /* defined(_WIN32) || defined(_WIN64) */
+}
+
+#if !defined(_WIN32) && !defined(_WIN64)
+/* The child of fork() runs on a new thread ID and must not write to the files of its parent */
+static void resetThreadAfterFork(void)
+{
+    Logger* lg;
+
+    s_threadID = 0;
+    s_threadFile = NULL;
+    s_default.flog.threadFiles = NULL;
+    /* the other threads and their levels are not inherited */
+    memset(s_threadLevels, 0, sizeof(s_threadLevels));
+    if (s_threadLevel != kNoThreadLevel) {
+        s_threadLevels[s_threadLevel] = 1;
+    }
+    updateEnabledLevel();
+    pthread_mutex_init(&s_instancesMutex, NULL);
+    for (lg = s_instances; lg != NULL; lg = lg->next) {
+        /* the writer thread is not inherited, and the lines it holds are the parent's */
+        pthread_mutex_init(&lg->clog.mutex, NULL);
+        pthread_cond_init(&lg->clog.ready, NULL);
+        pthread_cond_init(&lg->clog.drained, NULL);
+        lg->clog.async = 0;
+        lg->clog.used = 0;
+        lg->clog.writing = 0;
+        lg->clog.flushing = 0;
+        pthread_cond_init(&lg->flog.batchStarted, NULL);
+        lg->flog.flushing = 0;
+        pthread_cond_init(&lg->flog.fileSynced, NULL);
+        lg->flog.syncing = 0;
+        pthread_cond_init(&lg->retention.wakeup, NULL);
+        lg->retention.running = 0;
+        lg->retention.ndiscarded = 0; /* the parent releases them */
+    }
+}
+#endif /* !defined(_WIN32) && !defined(_WIN64) */
 
 static void init(void)
 {
     if (s_initialized) {
         return;
     }
+    initLogger(&s_default);
 #if defined(_WIN32) || defined(_WIN64)
-    InitializeCriticalSection(&s_mutex);
+    InitializeCriticalSection(&s_instancesMutex);
 #else
-    pthread_mutex_init(&s_mutex, NULL);
+    pthread_mutex_init(&s_instancesMutex, NULL);
+    pthread_atfork(NULL, NULL, resetThreadAfterFork);
+    pthread_key_create(&s_threadFileKey, closeThreadFile);
+    pthread_key_create(&s_lineBufferKeys[kLongLine], free);
+    pthread_key_create(&s_lineBufferKeys[kEscapedLine], free);
+    pthread_key_create(&s_profileKey, closeProfile);
+    pthread_key_create(&s_keptLinesKey, free);
+    pthread_key_create(&s_threadLevelKey, clearThreadLevel);
 #endif /* defined(_WIN32) || defined(_WIN64) */
+    compilePattern(kDefaultFormat, &s_defaultPattern);
+    s_pattern = &s_defaultPattern;
+    updateSites();
     s_initialized = 1; /* true */
 }
 
-static void lock(void)
+static void lock(Logger* lg)
 {
 #if defined(_WIN32) || defined(_WIN64)
-    EnterCriticalSection(&s_mutex);
+    EnterCriticalSection(&lg->mutex);
 #else
-    pthread_mutex_lock(&s_mutex);
+    pthread_mutex_lock(&lg->mutex);
 #endif /* defined(_WIN32) || defined(_WIN64) */
 }
 
-static void unlock(void)
+static int tryLock(Logger* lg)
 {
 #if defined(_WIN32) || defined(_WIN64)
-    LeaveCriticalSection(&s_mutex);
+    return TryEnterCriticalSection(&lg->mutex) != 0;
 #else
-    pthread_mutex_unlock(&s_mutex);
+    return pthread_mutex_trylock(&lg->mutex) == 0;
 #endif /* defined(_WIN32) || defined(_WIN64) */
 }
 
-#if defined(_WIN32) || defined(_WIN64)
-static int gettimeofday(struct timeval* tv, void* tz)
+static void unlock(Logger* lg)
 {
-    const UINT64 epochFileTime = 116444736000000000ULL;
-    FILETIME ft;
-    ULARGE_INTEGER li;
-    UINT64 t;
+#if defined(_WIN32) || defined(_WIN64)
+    LeaveCriticalSection(&lg->mutex);
+#else
+    pthread_mutex_unlock(&lg->mutex);
+#endif /* defined(_WIN32) || defined(_WIN64) */
+}
 
-    if (tv == NULL) {
-        return -1;
-    }
-    GetSystemTimeAsFileTime(&ft);
-    li.LowPart = ft.dwLowDateTime;
-    li.HighPart = ft.dwHighDateTime;
-    t = (li.QuadPart - epochFileTime) / 10;
-    tv->tv_sec = (long) (t / 1000000);
-    tv->tv_usec = t % 1000000;
-    return 0;
+static int hasFlag(int flags, int flag)
+{
+    return (flags & flag) == flag;
 }
 
+#if defined(_WIN32) || defined(_WIN64)
 static struct tm* localtime_r(const time_t* timep, struct tm* result)
 {
     localtime_s(result, timep);
     return result;
 }
+
+static struct tm* gmtime_r(const time_t* timep, struct tm* result)
+{
+    gmtime_s(result, timep);
+    return result;
+}
 #endif /* defined(_WIN32) || defined(_WIN64) */
 
-static long getCurrentThreadID(void)
+/* Read the wall clock in nanoseconds since the Epoch */
+static unsigned long long getWallClockNanos(void)
 {
 #if defined(_WIN32) || defined(_WIN64)
-    return GetCurrentThreadId();
-#elif __linux__
-    return syscall(SYS_gettid);
-#elif defined(__APPLE__) && defined(__MACH__)
-    return syscall(SYS_thread_selfid);
+    const unsigned long long epochFileTime = 116444736000000000ULL;
+    FILETIME ft;
+    ULARGE_INTEGER li;
+
+    GetSystemTimeAsFileTime(&ft);
+    li.LowPart = ft.dwLowDateTime;
+    li.HighPart = ft.dwHighDateTime;
+    return (li.QuadPart - epochFileTime) * 100;
 #else
-    return (long) pthread_self();
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (unsigned long long) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
 #endif /* defined(_WIN32) || defined(_WIN64) */
 }
 
-int logger_initConsoleLogger(FILE* output)
+/* Read a cheap monotonic clock in nanoseconds */
+static unsigned long long getMonotonicNanos(void)
 {
-    output = (output != NULL) ? output : stdout;
-    if (output != stdout && output != stderr) {
-        assert(0 && "output must be stdout or stderr");
-        return 0;
+#if defined(_WIN32) || defined(_WIN64)
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER count;
+
+    if (freq.QuadPart == 0) {
+        QueryPerformanceFrequency(&freq);
     }
+    QueryPerformanceCounter(&count);
+    return (unsigned long long) (count.QuadPart / freq.QuadPart) * 1000000000ULL
+            + (unsigned long long) (count.QuadPart % freq.QuadPart) * 1000000000ULL / freq.QuadPart;
+#else
+    struct timespec ts;
 
-    init();
-    lock();
-    s_clog.output = output;
-    s_logger |= kConsoleLogger;
-    unlock();
-    return 1;
+ #if defined(CLOCK_MONOTONIC_COARSE)
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+ #else
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+ #endif /* defined(CLOCK_MONOTONIC_COARSE) */
+    return (unsigned long long) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif /* defined(_WIN32) || defined(_WIN64) */
 }
 
-static long getFileSize(const char* filename)
+/* Capture the raw value of the current clock. This is all the hot path pays for.
+   Return the clock to convert the value with. */
+static const ClockState* readClock(unsigned long long* ticks)
 {
-    FILE* fp;
-    long size;
+    const ClockState* clock = loadAcquire(&s_clock);
 
-    if ((fp = fopen(filename, "rb")) == NULL) {
-        return 0;
+    switch (clock->type) {
+#if defined(HAVE_TSC)
+        case LogClock_TSC: *ticks = readTSC(); break;
+#endif /* defined(HAVE_TSC) */
+        case LogClock_MONOTONIC: *ticks = getMonotonicNanos(); break;
+        default: *ticks = getWallClockNanos(); break;
     }
-    fseek(fp, 0, SEEK_END);
-    size = ftell(fp);
-    fclose(fp);
-    return size;
+    return clock;
 }
 
-int logger_initFileLogger(const char* filename, long maxFileSize, unsigned char maxBackupFiles)
+/* Convert a raw value of a clock into wall-clock time */
+static void toLogTime(const ClockState* clock, unsigned long long ticks, LogTime* time)
 {
-    int ok = 0; /* false */
+    unsigned long long nanos;
 
-    if (filename == NULL) {
-        assert(0 && "filename must not be NULL");
-        return 0;
+    if (clock->type == LogClock_REALTIME) {
+        nanos = ticks;
+    } else if (ticks >= clock->baseTicks) {
+        nanos = clock->baseNanos + (unsigned long long) ((ticks - clock->baseTicks) * clock->nanosPerTick);
+    } else {
+        nanos = clock->baseNanos - (unsigned long long) ((clock->baseTicks - ticks) * clock->nanosPerTick);
     }
-    if (strlen(filename) > kMaxFileNameLen) {
-        assert(0 && "filename exceeds the maximum number of characters");
+    time->sec = (time_t) (nanos / 1000000000ULL);
+    time->nsec = (long) (nanos % 1000000000ULL);
+}
+
+static void sleepMillis(long msec)
+{
+#if defined(_WIN32) || defined(_WIN64)
+    Sleep(msec);
+#else
+    struct timespec ts;
+
+    ts.tv_sec = msec / 1000;
+    ts.tv_nsec = (msec % 1000) * 1000000L;
+    nanosleep(&ts, NULL);
+#endif /* defined(_WIN32) || defined(_WIN64) */
+}
+
+/* Publish a calibrated clock to the threads logging. The replaced clock is kept
+   since a thread may have read its ticks and not yet converted them. */
+static int publishClock(LogClock type, unsigned long long baseTicks,
+        unsigned long long baseNanos, double nanosPerTick)
+{
+    ClockState* clock;
+
+    if ((clock = (ClockState*) malloc(sizeof(ClockState))) == NULL) {
+        fprintf(stderr, "ERROR: logger: Failed to allocate memory for the clock\n");
         return 0;
     }
-
+    clock->type = type;
+    clock->baseTicks = baseTicks;
+    clock->baseNanos = baseNanos;
+    clock->nanosPerTick = nanosPerTick;
     init();
-    lock();
-    if (s_flog.output != NULL) { /* reinit */
-        fclose(s_flog.output);
-    }
-    s_flog.output = fopen(filename, "a");
-    if (s_flog.output == NULL) {
-        fprintf(stderr, "ERROR: logger: Failed to open file: `%s`\n", filename);
-        goto cleanup;
-    }
-    s_flog.currentFileSize = getFileSize(filename);
-    strncpy(s_flog.filename, filename, sizeof(s_flog.filename));
-    s_flog.maxFileSize = (maxFileSize > 0) ? maxFileSize : kDefaultMaxFileSize;
-    s_flog.maxBackupFiles = maxBackupFiles;
-    s_logger |= kFileLogger;
-    ok = 1; /* true */
-cleanup:
-    unlock();
-    return ok;
+    lock(&s_default);
+    clock->next = s_clocks;
+    s_clocks = clock;
+    storeRelease(&s_clock, clock);
+    unlock(&s_default);
+    return 1;
 }
 
-void logger_setLevel(LogLevel level)
+int logger_setClock(LogClock clock)
 {
-    s_logLevel = level;
+#if defined(HAVE_TSC)
+    unsigned long long tsc0, tsc1, mono0, mono1;
+    double nanosPerTick;
+#endif /* defined(HAVE_TSC) */
+
+    switch (clock) {
+        case LogClock_REALTIME:
+            storeRelease(&s_clock, &s_realtimeClock);
+            return 1;
+        case LogClock_MONOTONIC:
+            return publishClock(LogClock_MONOTONIC, getMonotonicNanos(), getWallClockNanos(), 1.0);
+        case LogClock_TSC:
+#if defined(HAVE_TSC)
+            mono0 = getMonotonicNanos();
+            tsc0 = readTSC();
+            sleepMillis(kClockCalibrationTime);
+            mono1 = getMonotonicNanos();
+            tsc1 = readTSC();
+            if (tsc1 <= tsc0 || mono1 <= mono0) {
+                fprintf(stderr, "ERROR: logger: Failed to calibrate the TSC clock\n");
+                return 0;
+            }
+            nanosPerTick = (double) (mono1 - mono0) / (double) (tsc1 - tsc0);
+            return publishClock(LogClock_TSC, readTSC(), getWallClockNanos(), nanosPerTick);
+#else
+            fprintf(stderr, "ERROR: logger: TSC clock is not supported on this platform\n");
+            storeRelease(&s_clock, &s_realtimeClock);
+            return 0;
+#endif /* defined(HAVE_TSC) */
+        default:
+            assert(0 && "unknown clock");
+            return 0;
+    }
 }
 
-LogLevel logger_getLevel(void)
+LogClock logger_getClock(void)
 {
-    return s_logLevel;
+    return loadAcquire(&s_clock)->type;
 }
 
-int logger_isEnabled(LogLevel level)
+static long getCurrentThreadID(void)
 {
-    return s_logLevel <= level;
+    if (s_threadID != 0) {
+        return s_threadID;
+    }
+#if defined(_WIN32) || defined(_WIN64)
+    s_threadID = GetCurrentThreadId();
+#elif __linux__
+    s_threadID = syscall(SYS_gettid);
+#elif defined(__APPLE__) && defined(__MACH__)
+    s_threadID = syscall(SYS_thread_selfid);
+#else
+    s_threadID = (long) pthread_self();
+#endif /* defined(_WIN32) || defined(_WIN64) */
+    return s_threadID;
 }
 
-void logger_autoFlush(long interval)
+#if defined(LOGGER_PROFILE)
+/* Read a fine clock to time the stages with: the TSC or else nanoseconds */
+static unsigned long long readCycles(void)
 {
-    s_flushInterval = interval > 0 ? interval : 0;
+#if defined(HAVE_TSC)
+    return readTSC();
+#elif defined(_WIN32) || defined(_WIN64)
+    return getMonotonicNanos();
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif /* defined(HAVE_TSC) */
 }
 
-static int hasFlag(int flags, int flag)
+/* Called first on a thread from outside the lock, which it takes to add the profile to the list */
+static Profile* openProfile(void)
 {
-    return (flags & flag) == flag;
+    Profile* p;
+
+    if ((p = (Profile*) calloc(1, sizeof(Profile))) == NULL) {
+        return NULL;
+    }
+    lock(&s_default);
+    p->next = s_profiles;
+    s_profiles = p;
+    unlock(&s_default);
+    s_profile = p;
+#if !defined(_WIN32) && !defined(_WIN64)
+    pthread_setspecific(s_profileKey, p);
+#endif /* !defined(_WIN32) && !defined(_WIN64) */
+    return p;
 }
 
-void logger_flush()
+/* Count the cycles since t in the histogram of the stage and restart t */
+static void profileStage(int stage, unsigned long long* t)
 {
-    if (s_logger == 0 || !s_initialized) {
-        assert(0 && "logger is not initialized");
-        return;
-    }
+    unsigned long long cycles = readCycles() - *t;
+    Profile* p = s_profile;
+    int bucket = 0;
 
-    if (hasFlag(s_logger, kConsoleLogger)) {
-        fflush(s_clog.output);
-    }
-    if (hasFlag(s_logger, kFileLogger)) {
-        fflush(s_flog.output);
+    if (p != NULL || (p = openProfile()) != NULL) {
+        while (bucket < kProfileBuckets - 1 && (cycles >> (bucket + 1)) != 0) {
+            bucket++;
+        }
+        /* read by logger_dumpProfile() while the thread logs */
+        storeRelaxed(&p->counts[stage][bucket], p->counts[stage][bucket] + 1);
+        storeRelaxed(&p->cycles[stage], p->cycles[stage] + cycles);
     }
+    *t = readCycles(); /* without the time spent here */
 }
 
-static char getLevelChar(LogLevel level)
+static void addProfile(Profile* dst, Profile* src)
 {
-    switch (level) {
-        case LogLevel_TRACE: return 'T';
-        case LogLevel_DEBUG: return 'D';
-        case LogLevel_INFO:  return 'I';
-        case LogLevel_WARN:  return 'W';
-        case LogLevel_ERROR: return 'E';
-        case LogLevel_FATAL: return 'F';
-        default: return ' ';
+    int i, j;
+
+    for (i = 0; i < kStages; i++) {
+        for (j = 0; j < kProfileBuckets; j++) {
+            dst->counts[i][j] += loadRelaxed(&src->counts[i][j]);
+        }
+        dst->cycles[i] += loadRelaxed(&src->cycles[i]);
     }
 }
+#endif /* defined(LOGGER_PROFILE) */
 
-static void getTimestamp(const struct timeval* time, char* timestamp, size_t size)
+#if !defined(_WIN32) && !defined(_WIN64)
+/* Called at the exit of a thread that has logged with LOGGER_PROFILE */
+static void closeProfile(void* arg)
 {
-    time_t sec = time->tv_sec; /* a necessary variable to avoid a runtime error on Windows */
-    struct tm calendar;
-
-    assert(size >= 25);
+#if defined(LOGGER_PROFILE)
+    Profile* p = (Profile*) arg;
+    Profile** pp;
 
-    localtime_r(&sec, &calendar);
-    strftime(timestamp, size, "%y-%m-%d %H:%M:%S", &calendar);
-    sprintf(&timestamp[17], ".%06ld", (long) time->tv_usec);
+    lock(&s_default);
+    for (pp = &s_profiles; *pp != NULL; pp = &(*pp)->next) {
+        if (*pp == p) {
+            *pp = p->next;
+            break;
+        }
+    }
+    addProfile(&s_exitedProfile, p);
+    unlock(&s_default);
+    free(p);
+#endif /* defined(LOGGER_PROFILE) */
 }
+#endif /* !defined(_WIN32) && !defined(_WIN64) */
 
-static void getBackupFileName(const char* basename, unsigned char index,
-        char* backupname, size_t size)
+#if defined(_WIN32) || defined(_WIN64)
+static int isTerminal(FILE* output)
 {
-    char indexname[5];
+    return 0; /* not colored */
+}
 
-    assert(size >= strlen(basename) + sizeof(indexname));
+static int startConsoleWriter(Logger* lg)
+{
+    return 0;
+}
 
-    strncpy(backupname, basename, size);
-    if (index > 0) {
-        sprintf(indexname, ".%d", index);
-        strncat(backupname, indexname, strlen(indexname));
-    }
+static void stopConsoleWriter(Logger* lg)
+{
 }
 
-static int isFileExist(const char* filename)
+static void appendConsole(Logger* lg, const char* text, size_t len, LogLevel level)
 {
-    FILE* fp;
+}
 
-    if ((fp = fopen(filename, "r")) == NULL) {
-        return 0;
-    } else {
-        fclose(fp);
-        return 1;
-    }
+static void waitConsoleWriter(Logger* lg)
+{
+}
+#else
+static int isTerminal(FILE* output)
+{
+    return isatty(fileno(output));
 }
 
-static int rotateLogFiles(void)
+/* Wait for lines to write. A pipe or file is written in batches unless the lines
+   have waited for kConsoleFlushInterval. Return 0 when stopped. */
+static int waitConsoleLines(Logger* lg)
 {
-    int i;
-    /* backup filename: <filename>.xxx (xxx: 1-255) */
-    char src[kMaxFileNameLen + 5], dst[kMaxFileNameLen + 5]; /* with null character */
-
-    if (s_flog.currentFileSize < s_flog.maxFileSize) {
-        return s_flog.output != NULL;
-    }
-    fclose(s_flog.output);
-    for (i = (int) s_flog.maxBackupFiles; i > 0; i--) {
-        getBackupFileName(s_flog.filename, i - 1, src, sizeof(src));
-        getBackupFileName(s_flog.filename, i, dst, sizeof(dst));
-        if (isFileExist(dst)) {
-            if (remove(dst) != 0) {
-                fprintf(stderr, "ERROR: logger: Failed to remove file: `%s`\n", dst);
+    struct timespec deadline;
+    int timedout = 0; /* false */
+
+    for (;;) {
+        if (lg->clog.used == 0) {
+            if (lg->clog.stopping) {
+                return 0;
             }
+            pthread_cond_wait(&lg->clog.ready, &lg->clog.mutex);
+            continue;
         }
-        if (isFileExist(src)) {
-            if (rename(src, dst) != 0) {
-                fprintf(stderr, "ERROR: logger: Failed to rename file: `%s` -> `%s`\n", src, dst);
-            }
+        if (lg->clog.terminal || lg->clog.used >= kConsoleBatchSize || lg->clog.flushing > 0
+                || lg->clog.urgent || lg->clog.stopping || timedout) {
+            return 1;
         }
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += kConsoleFlushInterval * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        timedout = pthread_cond_timedwait(&lg->clog.ready, &lg->clog.mutex, &deadline) == ETIMEDOUT;
     }
-    s_flog.output = fopen(s_flog.filename, "a");
-    if (s_flog.output == NULL) {
-        fprintf(stderr, "ERROR: logger: Failed to open file: `%s`\n", s_flog.filename);
-        return 0;
-    }
-    s_flog.currentFileSize = getFileSize(s_flog.filename);
-    return 1;
 }
 
-static long vflog(FILE* fp, char levelc, const char* timestamp, long threadID,
-        const char* file, int line, const char* fmt, va_list arg,
-        unsigned long long currentTime, unsigned long long* flushedTime)
+/* Write the console lines on a thread of their own so that a slow reader stalls only it */
+static void* runConsoleWriter(void* arg)
 {
-    int size;
-    long totalsize = 0;
+    Logger* lg = (Logger*) arg;
+    int fd = fileno(lg->clog.output);
+    char* buffer;
+    size_t len, n;
+    ssize_t written;
 
-    if ((size = fprintf(fp, "%c %s %ld %s:%d: ", levelc, timestamp, threadID, file, line)) > 0) {
-        totalsize += size;
-    }
-    if ((size = vfprintf(fp, fmt, arg)) > 0) {
-        totalsize += size;
-    }
-    if ((size = fprintf(fp, "\n")) > 0) {
-        totalsize += size;
-    }
-    if (s_flushInterval > 0) {
-        if (currentTime - *flushedTime > s_flushInterval) {
-            fflush(fp);
-            *flushedTime = currentTime;
+    pthread_mutex_lock(&lg->clog.mutex);
+    while (waitConsoleLines(lg)) {
+        buffer = lg->clog.buffer;
+        len = lg->clog.used;
+        lg->clog.buffer = (buffer == lg->clog.buffers[0]) ? lg->clog.buffers[1] : lg->clog.buffers[0];
+        lg->clog.used = 0;
+        lg->clog.urgent = 0; /* false */
+        lg->clog.writing = 1; /* true */
+        pthread_mutex_unlock(&lg->clog.mutex);
+        for (n = 0; n < len; n += written) {
+            if ((written = write(fd, &buffer[n], len - n)) < 0) {
+                if (errno != EINTR) {
+                    break; /* the lines are lost with the reader */
+                }
+                written = 0;
+            }
         }
+        pthread_mutex_lock(&lg->clog.mutex);
+        lg->clog.writing = 0; /* false */
+        pthread_cond_broadcast(&lg->clog.drained);
     }
-    return totalsize;
+    pthread_mutex_unlock(&lg->clog.mutex);
+    return NULL;
+}
+
+/* Write the remaining lines and stop the writer thread */
+static void stopConsoleWriter(Logger* lg)
+{
+    if (!lg->clog.async) {
+        return;
+    }
+    pthread_mutex_lock(&lg->clog.mutex);
+    lg->clog.stopping = 1; /* true */
+    pthread_cond_signal(&lg->clog.ready);
+    pthread_mutex_unlock(&lg->clog.mutex);
+    pthread_join(lg->clog.writer, NULL);
+    lg->clog.stopping = 0; /* false */
+    lg->clog.async = 0; /* false */
+}
+
+static void stopConsoleAtExit(void)
+{
+    Logger* lg;
+
+    lockInstances();
+    for (lg = s_instances; lg != NULL; lg = lg->next) {
+        lock(lg);
+        stopConsoleWriter(lg);
+        unlock(lg);
+    }
+    unlockInstances();
+}
+
+static int startConsoleWriter(Logger* lg)
+{
+    static int registered = 0; /* false */
+
+    if (lg->clog.buffers[0] == NULL) {
+        if ((lg->clog.buffers[0] = (char*) malloc(kConsoleBufferSize * 2)) == NULL) {
+            fprintf(stderr, "ERROR: logger: Failed to allocate a console buffer\n");
+            return 0;
+        }
+        lg->clog.buffers[1] = &lg->clog.buffers[0][kConsoleBufferSize];
+    }
+    lg->clog.buffer = lg->clog.buffers[0];
+    lg->clog.used = 0;
+    fflush(lg->clog.output);
+    if (pthread_create(&lg->clog.writer, NULL, runConsoleWriter, lg) != 0) {
+        fprintf(stderr, "ERROR: logger: Failed to start a console writer\n");
+        return 0;
+    }
+    lg->clog.async = 1; /* true */
+    if (!registered) {
+        atexit(stopConsoleAtExit);
+        registered = 1; /* true */
+    }
+    return 1;
+}
+
+/* Queue a line for the writer thread, dropping it if the writer is too far behind */
+static void appendConsole(Logger* lg, const char* text, size_t len, LogLevel level)
+{
+    size_t used, colorlen = lg->clog.colored ? kLevelColorLens[level] : 0;
+    char* dst;
+
+    pthread_mutex_lock(&lg->clog.mutex);
+    used = lg->clog.used;
+    if (used + len + (colorlen > 0 ? colorlen + sizeof(kColorReset) - 2 : 0) > kConsoleBufferSize) {
+        lg->clog.droppedLines++;
+        pthread_mutex_unlock(&lg->clog.mutex);
+        return;
+    }
+    dst = &lg->clog.buffer[used];
+    if (colorlen > 0) {
+        memcpy(dst, kLevelColors[level], colorlen);
+        memcpy(&dst[colorlen], text, len - 1);
+        memcpy(&dst[colorlen + len - 1], kColorReset, sizeof(kColorReset) - 1);
+        len += colorlen + sizeof(kColorReset) - 2;
+    } else {
+        memcpy(dst, text, len);
+    }
+    lg->clog.used = used + len;
+    if ((int) level >= loadRelaxed(&s_flushLevel)) {
+        lg->clog.urgent = 1; /* true */
+    }
+    /* the first line starts the batch interval of the writer */
+    if (used == 0 || lg->clog.terminal || lg->clog.urgent
+            || (used < kConsoleBatchSize && lg->clog.used >= kConsoleBatchSize)) {
+        pthread_cond_signal(&lg->clog.ready);
+    }
+    pthread_mutex_unlock(&lg->clog.mutex);
+}
+
+/* Wait for the writer thread to write the lines queued so far */
+static void waitConsoleWriter(Logger* lg)
+{
+    pthread_mutex_lock(&lg->clog.mutex);
+    lg->clog.flushing++;
+    pthread_cond_signal(&lg->clog.ready);
+    while (lg->clog.used > 0 || lg->clog.writing) {
+        pthread_cond_wait(&lg->clog.drained, &lg->clog.mutex);
+    }
+    lg->clog.flushing--;
+    pthread_mutex_unlock(&lg->clog.mutex);
+}
+
+#endif /* defined(_WIN32) || defined(_WIN64) */
+
+int logger_initConsoleLogger(FILE* output)
+{
+    return logger_initConsoleLoggerEx(output, 0);
+}
+
+int logger_initConsoleLoggerEx(FILE* output, int options)
+{
+    init();
+    return initConsoleLogger(&s_default, output, options);
+}
+
+static int initConsoleLogger(Logger* lg, FILE* output, int options)
+{
+    int ok = 1; /* true */
+
+    output = (output != NULL) ? output : stdout;
+    if (output != stdout && output != stderr) {
+        assert(0 && "output must be stdout or stderr");
+        return 0;
+    }
+
+    lock(lg);
+    stopConsoleWriter(lg);
+    lg->clog.output = output;
+    lg->clog.terminal = isTerminal(output);
+    lg->clog.colored = lg->clog.terminal && hasFlag(options, LogConsoleOption_COLOR);
+    if (hasFlag(options, LogConsoleOption_ASYNC)) {
+        ok = startConsoleWriter(lg);
+    }
+    if (ok) {
+        storeRelaxed(&lg->loggers, lg->loggers | kConsoleLogger);
+    }
+    unlock(lg);
+    return ok;
+}
+
+static long getFileSize(const char* filename)
+{
+    FILE* fp;
+    long size;
+
+    if ((fp = fopen(filename, "rb")) == NULL) {
+        return 0;
+    }
+    fseek(fp, 0, SEEK_END);
+    size = ftell(fp);
+    fclose(fp);
+    return size;
+}
+
+#if defined(_WIN32) || defined(_WIN64)
+static int openSharedFile(Logger* lg, const char* filename)
+{
+    fprintf(stderr, "ERROR: logger: Shared file logging is not supported on this platform\n");
+    return 0;
+}
+
+static void closeSharedFile(Logger* lg)
+{
+}
+
+static int lockSharedFile(Logger* lg)
+{
+    return 0;
+}
+
+static void unlockSharedFile(Logger* lg)
+{
+}
+
+static long addSharedFileSize(Logger* lg, long size)
+{
+    return 0;
+}
+#else
+static int lockSharedFile(Logger* lg)
+{
+    struct flock fl;
+
+    memset(&fl, 0, sizeof(fl));
+    fl.l_type = F_WRLCK;
+    fl.l_whence = SEEK_SET;
+    return fcntl(lg->flog.sharedfd, F_SETLKW, &fl) == 0;
+}
+
+static void unlockSharedFile(Logger* lg)
+{
+    struct flock fl;
+
+    memset(&fl, 0, sizeof(fl));
+    fl.l_type = F_UNLCK;
+    fl.l_whence = SEEK_SET;
+    fcntl(lg->flog.sharedfd, F_SETLK, &fl);
+}
+
+static int openSharedFile(Logger* lg, const char* filename)
+{
+    char name[kMaxFileNameLen + 6]; /* <filename>.lock */
+    struct stat st;
+    void* addr;
+
+    sprintf(name, "%s.lock", filename);
+    if ((lg->flog.sharedfd = open(name, O_RDWR | O_CREAT, 0644)) < 0) {
+        fprintf(stderr, "ERROR: logger: Failed to open file: `%s`\n", name);
+        return 0;
+    }
+    if (fstat(lg->flog.sharedfd, &st) != 0
+            || (st.st_size < (off_t) sizeof(SharedFileState)
+                && ftruncate(lg->flog.sharedfd, sizeof(SharedFileState)) != 0)) {
+        fprintf(stderr, "ERROR: logger: Failed to resize file: `%s`\n", name);
+        close(lg->flog.sharedfd);
+        return 0;
+    }
+    addr = mmap(NULL, sizeof(SharedFileState), PROT_READ | PROT_WRITE, MAP_SHARED, lg->flog.sharedfd, 0);
+    if (addr == MAP_FAILED) {
+        fprintf(stderr, "ERROR: logger: Failed to map file: `%s`\n", name);
+        close(lg->flog.sharedfd);
+        return 0;
+    }
+    lg->flog.shared = (SharedFileState*) addr;
+    /* the first process initializes the state */
+    lockSharedFile(lg);
+    if (lg->flog.shared->magic != kSharedFileMagic) {
+        lg->flog.shared->fileSize = getFileSize(filename);
+        lg->flog.shared->generation = 0;
+        lg->flog.shared->magic = kSharedFileMagic;
+    }
+    lg->flog.generation = lg->flog.shared->generation;
+    unlockSharedFile(lg);
+    return 1;
+}
+
+static void closeSharedFile(Logger* lg)
+{
+    if (lg->flog.shared == NULL) {
+        return;
+    }
+    munmap((void*) lg->flog.shared, sizeof(SharedFileState));
+    close(lg->flog.sharedfd);
+    lg->flog.shared = NULL;
+}
+
+static long addSharedFileSize(Logger* lg, long size)
+{
+    return __sync_add_and_fetch(&lg->flog.shared->fileSize, size);
+}
+#endif /* defined(_WIN32) || defined(_WIN64) */
+
+/* Reserve the blocks of a whole file up front without changing its size */
+static void preallocateFile(Logger* lg, int fd)
+{
+#if defined(__linux__) && defined(FALLOC_FL_KEEP_SIZE)
+    if (hasFlag(lg->flog.options, LogFileOption_PREALLOCATE)) {
+        fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, lg->flog.maxFileSize);
+    }
+#endif /* defined(__linux__) && defined(FALLOC_FL_KEEP_SIZE) */
+}
+
+#if defined(HAVE_DIRECT_IO)
+/* Write the buffer padded to whole blocks and keep its last partial block */
+static int syncDirectFile(DirectFile* df)
+{
+    size_t len = (df->used + kDirectBlockSize - 1) & ~((size_t) kDirectBlockSize - 1);
+    size_t full = df->used & ~((size_t) kDirectBlockSize - 1);
+
+    if (len == 0) {
+        return 1;
+    }
+    memset(&df->buffer[df->used], 0, len - df->used);
+    if (pwrite(df->fd, df->buffer, len, df->offset) != (ssize_t) len) {
+        return 0;
+    }
+    memmove(df->buffer, &df->buffer[full], df->used - full);
+    df->offset += full;
+    df->used -= full;
+    return 1;
+}
+
+static ssize_t writeDirectFile(void* cookie, const char* data, size_t size)
+{
+    DirectFile* df = (DirectFile*) cookie;
+    size_t n, done = 0;
+
+    while (done < size) {
+        n = kDirectBufferSize - df->used;
+        n = (size - done < n) ? size - done : n;
+        memcpy(&df->buffer[df->used], &data[done], n);
+        df->used += n;
+        done += n;
+        if (!syncDirectFile(df)) {
+            return -1;
+        }
+    }
+    return size;
+}
+
+/* Cut the padding of the last block and the preallocated blocks off the file */
+static int closeDirectFile(void* cookie)
+{
+    DirectFile* df = (DirectFile*) cookie;
+    int ok;
+
+    ok = syncDirectFile(df) && ftruncate(df->fd, df->offset + df->used) == 0;
+    close(df->fd);
+    free(df->buffer);
+    free(df);
+    return ok ? 0 : -1;
+}
+
+/* Open the file bypassing the page cache. Return NULL if the file system does not support it. */
+static FILE* openDirectFile(Logger* lg, const char* filename, int* fd)
+{
+    cookie_io_functions_t io = { NULL, writeDirectFile, NULL, closeDirectFile };
+    DirectFile* df;
+    struct stat st;
+    FILE* fp;
+    void* buffer;
+
+    if ((df = (DirectFile*) malloc(sizeof(DirectFile))) == NULL) {
+        return NULL;
+    }
+    if (posix_memalign(&buffer, kDirectBlockSize, kDirectBufferSize) != 0) {
+        free(df);
+        return NULL;
+    }
+    df->buffer = (char*) buffer;
+    if ((df->fd = open(filename, O_RDWR | O_CREAT | O_DIRECT, 0644)) < 0) {
+        goto error;
+    }
+    /* append to the last partial block of an existing file */
+    if (fstat(df->fd, &st) != 0) {
+        goto error;
+    }
+    df->offset = st.st_size & ~((long long) kDirectBlockSize - 1);
+    df->used = st.st_size - df->offset;
+    if (df->used > 0
+            && pread(df->fd, df->buffer, kDirectBlockSize, df->offset) < (ssize_t) df->used) {
+        goto error;
+    }
+    if ((fp = fopencookie(df, "w", io)) == NULL) {
+        goto error;
+    }
+    setvbuf(fp, NULL, _IOFBF, kDirectBufferSize);
+    preallocateFile(lg, df->fd);
+    *fd = df->fd; /* the stream of the cookie has none */
+    return fp;
+error:
+    if (df->fd >= 0) {
+        close(df->fd);
+    }
+    free(df->buffer);
+    free(df);
+    return NULL;
+}
+#endif /* defined(HAVE_DIRECT_IO) */
+
+/* Open an output file and get the descriptor to sync it with. Shared files write every
+   record with one write(2). */
+static FILE* openLogFile(Logger* lg, const char* filename, int* fd)
+{
+    FILE* fp;
+
+#if defined(HAVE_DIRECT_IO)
+    if (hasFlag(lg->flog.options, LogFileOption_DIRECT)
+            && (fp = openDirectFile(lg, filename, fd)) != NULL) {
+        return fp;
+    }
+#endif /* defined(HAVE_DIRECT_IO) */
+    if ((fp = fopen(filename, "a")) == NULL) {
+        fprintf(stderr, "ERROR: logger: Failed to open file: `%s`\n", filename);
+        return NULL;
+    }
+    if (lg->flog.shared != NULL) {
+        setvbuf(fp, NULL, _IOFBF, kSharedFileBufferSize);
+    } else if (hasFlag(lg->flog.options, LogFileOption_PER_THREAD)) {
+        setvbuf(fp, NULL, _IOFBF, kThreadFileBufferSize);
+    } else if (hasFlag(lg->flog.options, LogFileOption_ADAPTIVE)) {
+        setvbuf(fp, NULL, _IOFBF, kMaxBatchSize);
+    }
+    *fd = fileno(fp);
+    preallocateFile(lg, *fd);
+    return fp;
+}
+
+/* Close an output file releasing the preallocated blocks past its end */
+static void closeLogFile(Logger* lg, FILE* fp)
+{
+#if !defined(_WIN32) && !defined(_WIN64)
+    struct stat st;
+
+    /* the other processes sharing the file may append until it is closed */
+    if (hasFlag(lg->flog.options, LogFileOption_PREALLOCATE) && lg->flog.shared == NULL
+            && fileno(fp) >= 0 && fflush(fp) == 0 && fstat(fileno(fp), &st) == 0) {
+        ftruncate(fileno(fp), st.st_size);
+    }
+#endif /* !defined(_WIN32) && !defined(_WIN64) */
+    fclose(fp);
+}
+
+/* Open <filename>.idx and write its header if it is new */
+static int openIndexFile(Logger* lg)
+{
+    char name[kMaxFileNameLen + sizeof(kIndexSuffix)];
+
+    sprintf(name, "%s%s", lg->flog.filename, kIndexSuffix);
+    if ((lg->flog.index = fopen(name, "ab")) == NULL) {
+        fprintf(stderr, "ERROR: logger: Failed to open file: `%s`\n", name);
+        return 0;
+    }
+    if (getFileSize(name) == 0) {
+        fwrite(kIndexMagic, 1, sizeof(kIndexMagic) - 1, lg->flog.index);
+    }
+    return 1;
+}
+
+static void closeIndexFile(Logger* lg)
+{
+    if (lg->flog.index != NULL) {
+        fclose(lg->flog.index);
+        lg->flog.index = NULL;
+    }
+    lg->flog.indexedSize = 0;
+}
+
+/* Map the time of the record to the offset it is written at */
+static void indexRecord(Logger* lg, const LogRecord* rec)
+{
+    IndexEntry entry;
+
+    /* the other processes move the end of a shared file */
+    if (lg->flog.shared != NULL || (lg->flog.index == NULL && !openIndexFile(lg))) {
+        lg->flog.indexedSize = lg->flog.currentFileSize + lg->flog.indexInterval;
+        return;
+    }
+    entry.time = (unsigned long long) rec->time.sec * 1000000 + rec->time.nsec / 1000;
+    entry.offset = lg->flog.currentFileSize;
+    fwrite(&entry, sizeof(entry), 1, lg->flog.index);
+    lg->flog.indexedSize = lg->flog.currentFileSize + lg->flog.indexInterval;
+}
+
+/* Write the buffered lines to the file, and with sync down to the disk. O_DIRECT writes
+   bypass the page cache but still need the sync for the file size and the drive cache. */
+static void flushFile(FILE* fp, int fd, int sync)
+{
+    fflush(fp);
+    if (!sync) {
+        return;
+    }
+#if defined(_WIN32) || defined(_WIN64)
+    _commit(fd);
+#elif defined(__APPLE__)
+    fsync(fd);
+#else
+    fdatasync(fd);
+#endif /* defined(_WIN32) || defined(_WIN64) */
+}
+
+/* Account the bytes written to the file */
+static void addFileSize(Logger* lg, long size)
+{
+    lg->flog.written++;
+    if (lg->flog.shared != NULL) {
+        fflush(lg->flog.output); /* whole lines with O_APPEND do not interleave */
+        lg->flog.currentFileSize = addSharedFileSize(lg, size);
+    } else {
+        lg->flog.currentFileSize += size;
+    }
+}
+
+/* Batching applies to the file written by the logging threads in turn */
+static int isAdaptive(Logger* lg)
+{
+    return hasFlag(lg->flog.options, LogFileOption_ADAPTIVE) && lg->flog.shared == NULL
+            && !hasFlag(lg->flog.options, LogFileOption_PER_THREAD);
+}
+
+/* Write the batch once it is large or old enough. The batch grows while lines arrive
+   in bursts or other threads wait for the lock, and shrinks back to single lines
+   while the traffic is light. */
+static void batchFile(Logger* lg, const LogRecord* rec, long size, int contended)
+{
+    unsigned long long now = (unsigned long long) rec->time.sec * 1000000 + rec->time.nsec / 1000;
+    unsigned long long interval = now - lg->flog.lastTime;
+
+    if (contended || interval < kBurstInterval) {
+        lg->flog.batchSize = (lg->flog.batchSize < kMinBatchSize) ? kMinBatchSize : lg->flog.batchSize * 2;
+        if (lg->flog.batchSize > kMaxBatchSize) {
+            lg->flog.batchSize = kMaxBatchSize;
+        }
+    } else if (interval >= kMaxBatchDelay) {
+        lg->flog.batchSize = 0;
+    } else if ((lg->flog.batchSize /= 2) < kMinBatchSize) {
+        lg->flog.batchSize = 0;
+    }
+    lg->flog.lastTime = now;
+    if (lg->flog.batched == 0) {
+        lg->flog.batchTime = now;
+    }
+    lg->flog.batched += size;
+    if (lg->flog.batched >= lg->flog.batchSize || now - lg->flog.batchTime >= kMaxBatchDelay) {
+        fflush(lg->flog.output);
+        lg->flog.batched = 0;
+#if !defined(_WIN32) && !defined(_WIN64)
+    } else if (lg->flog.batched == size && lg->flog.flushing) {
+        pthread_cond_signal(&lg->flog.batchStarted);
+#endif /* !defined(_WIN32) && !defined(_WIN64) */
+    }
+}
+
+#if defined(_WIN32) || defined(_WIN64)
+static void startFileFlusher(Logger* lg)
+{
+}
+
+static void stopFileFlusher(Logger* lg)
+{
+}
+#else
+/* Write the batch that has waited for kMaxBatchDelay without a line to complete it */
+static void* runFileFlusher(void* arg)
+{
+    Logger* lg = (Logger*) arg;
+    struct timespec deadline;
+    unsigned long long due;
+
+    lock(lg);
+    while (!lg->flog.stopping) {
+        if (lg->flog.batched == 0) {
+            pthread_cond_wait(&lg->flog.batchStarted, &lg->mutex);
+            continue;
+        }
+        due = lg->flog.batchTime + kMaxBatchDelay;
+        if (getWallClockNanos() / 1000 >= due) {
+            fflush(lg->flog.output);
+            lg->flog.batched = 0;
+            continue;
+        }
+        deadline.tv_sec = (time_t) (due / 1000000);
+        deadline.tv_nsec = (long) (due % 1000000) * 1000;
+        pthread_cond_timedwait(&lg->flog.batchStarted, &lg->mutex, &deadline);
+    }
+    unlock(lg);
+    return NULL;
+}
+
+static void startFileFlusher(Logger* lg)
+{
+    if (lg->flog.flushing) {
+        return;
+    }
+    lg->flog.stopping = 0; /* false */
+    if (pthread_create(&lg->flog.flusher, NULL, runFileFlusher, lg) == 0) {
+        lg->flog.flushing = 1; /* true */
+    }
+}
+
+/* Stop the flusher thread. Called with the lock held, which the flusher needs to stop. */
+static void stopFileFlusher(Logger* lg)
+{
+    pthread_t flusher = lg->flog.flusher;
+
+    if (!lg->flog.flushing) {
+        return;
+    }
+    lg->flog.flushing = 0; /* false */
+    lg->flog.stopping = 1; /* true */
+    pthread_cond_signal(&lg->flog.batchStarted);
+    unlock(lg);
+    pthread_join(flusher, NULL);
+    lock(lg);
+}
+#endif /* defined(_WIN32) || defined(_WIN64) */
+
+static int isDurable(Logger* lg)
+{
+    return hasFlag(lg->flog.options, LogFileOption_SYNC_PERIODIC)
+            || hasFlag(lg->flog.options, LogFileOption_SYNC_GROUP);
+}
+
+/* Sync the file about to be closed under the lock, as no later sync can reach it */
+static void syncClosingFile(Logger* lg)
+{
+    if (isDurable(lg)) {
+        flushFile(lg->flog.output, lg->flog.fd, 1);
+        lg->flog.synced = lg->flog.written;
+        lg->flog.syncs++;
+    }
+}
+
+#if defined(_WIN32) || defined(_WIN64)
+static void syncLogFile(Logger* lg)
+{
+    if (lg->flog.output != NULL && lg->flog.synced < lg->flog.written) {
+        flushFile(lg->flog.output, lg->flog.fd, 1);
+        lg->flog.batched = 0;
+        lg->flog.synced = lg->flog.written;
+        lg->flog.syncs++;
+    }
+}
+#else
+/* Sync the writes made so far. Called with the lock held, which is released while one
+   thread syncs the file; the others wait for it, and the writes made meanwhile are
+   synced together by the next one. */
+static void syncLogFile(Logger* lg)
+{
+    unsigned long long target = lg->flog.written;
+    int fd;
+
+    while (lg->flog.synced < target) {
+        if (lg->flog.syncing) {
+            pthread_cond_wait(&lg->flog.fileSynced, &lg->mutex);
+            continue;
+        }
+        if (lg->flog.output == NULL) {
+            return;
+        }
+        fflush(lg->flog.output);
+        lg->flog.batched = 0;
+        target = lg->flog.written;
+        /* a rotation may close the file while it is synced */
+        if ((fd = dup(lg->flog.fd)) < 0) {
+            return;
+        }
+        lg->flog.syncing = 1; /* true */
+        unlock(lg);
+#if defined(__APPLE__)
+        fsync(fd);
+#else
+        fdatasync(fd);
+#endif /* defined(__APPLE__) */
+        close(fd);
+        lock(lg);
+        lg->flog.syncing = 0; /* false */
+        if (lg->flog.synced < target) {
+            lg->flog.synced = target;
+        }
+        lg->flog.syncs++;
+        pthread_cond_broadcast(&lg->flog.fileSynced);
+    }
+}
+#endif /* defined(_WIN32) || defined(_WIN64) */
+
+/* Follow a rotation done by another process. The size of the new file is read
+   under the lock of the shared file, which the rotating process holds until
+   both the size and the generation are published. */
+static int syncSharedFile(Logger* lg, int locked)
+{
+    if (lg->flog.shared->generation != lg->flog.generation) {
+        if (!locked && !lockSharedFile(lg)) {
+            return lg->flog.output != NULL;
+        }
+        if (lg->flog.output != NULL) {
+            closeLogFile(lg, lg->flog.output);
+        }
+        lg->flog.output = openLogFile(lg, lg->flog.filename, &lg->flog.fd);
+        lg->flog.generation = lg->flog.shared->generation;
+        lg->flog.currentFileSize = lg->flog.shared->fileSize;
+        if (!locked) {
+            unlockSharedFile(lg);
+        }
+        return lg->flog.output != NULL;
+    }
+    lg->flog.currentFileSize = lg->flog.shared->fileSize;
+    return lg->flog.output != NULL;
+}
+
+int logger_initFileLogger(const char* filename, long maxFileSize, unsigned char maxBackupFiles)
+{
+    return logger_initFileLoggerEx(filename, maxFileSize, maxBackupFiles, 0);
+}
+
+int logger_initFileLoggerEx(const char* filename, long maxFileSize, unsigned char maxBackupFiles,
+        int options)
+{
+    init();
+    return initFileLogger(&s_default, filename, maxFileSize, maxBackupFiles, options);
+}
+
+static int initFileLogger(Logger* lg, const char* filename, long maxFileSize,
+        unsigned char maxBackupFiles, int options)
+{
+    int ok = 0; /* false */
+
+    if (filename == NULL) {
+        assert(0 && "filename must not be NULL");
+        return 0;
+    }
+    if (strlen(filename) > kMaxFileNameLen) {
+        assert(0 && "filename exceeds the maximum number of characters");
+        return 0;
+    }
+    if (hasFlag(options, LogFileOption_SHARED) && hasFlag(options, LogFileOption_DIRECT)) {
+        assert(0 && "shared files cannot be written with O_DIRECT");
+        return 0;
+    }
+    if (hasFlag(options, LogFileOption_SHARED) && hasFlag(options, LogFileOption_PER_THREAD)) {
+        assert(0 && "shared files cannot be written per thread");
+        return 0;
+    }
+#if defined(_WIN32) || defined(_WIN64)
+    if (hasFlag(options, LogFileOption_PER_THREAD)) {
+        fprintf(stderr, "ERROR: logger: Per-thread file logging is not supported on this platform\n");
+        return 0;
+    }
+#endif /* defined(_WIN32) || defined(_WIN64) */
+
+    lock(lg);
+    stopFileFlusher(lg);
+    if (lg->flog.output != NULL) { /* reinit */
+        writeRepeatSummary(lg->flog.output, &lg->flog.dedup);
+        syncClosingFile(lg);
+        closeLogFile(lg, lg->flog.output);
+        lg->flog.output = NULL;
+    }
+    lg->flog.batchSize = 0;
+    lg->flog.batched = 0;
+    lg->flog.syncedTime = 0;
+    closeIndexFile(lg);
+    closeSharedFile(lg);
+    if (hasFlag(options, LogFileOption_SHARED) && !openSharedFile(lg, filename)) {
+        goto cleanup;
+    }
+    storeRelaxed(&lg->flog.options, options);
+    lg->flog.maxFileSize = (maxFileSize > 0) ? maxFileSize : kDefaultMaxFileSize;
+    /* every thread opens <filename>.t<thread ID> when it first logs */
+    if (!hasFlag(options, LogFileOption_PER_THREAD)) {
+        lg->flog.output = openLogFile(lg, filename, &lg->flog.fd);
+        if (lg->flog.output == NULL) {
+            closeSharedFile(lg);
+            goto cleanup;
+        }
+        lg->flog.currentFileSize = (lg->flog.shared != NULL) ? lg->flog.shared->fileSize : getFileSize(filename);
+    }
+    strncpy(lg->flog.filename, filename, sizeof(lg->flog.filename));
+    lg->flog.maxBackupFiles = maxBackupFiles;
+    if (isAdaptive(lg)) {
+        startFileFlusher(lg);
+    }
+    storeRelaxed(&lg->flog.threadGeneration, lg->flog.threadGeneration + 1);
+    storeRelaxed(&lg->loggers, lg->loggers | kFileLogger);
+    ok = 1; /* true */
+cleanup:
+    unlock(lg);
+    return ok;
+}
+
+static unsigned long long getCurrentMillis(void)
+{
+    return getWallClockNanos() / 1000000;
+}
+
+#if defined(_WIN32) || defined(_WIN64)
+static int initSocketLogger(Logger* lg, const char* path, LogSocketType type)
+{
+    fprintf(stderr, "ERROR: logger: Socket logger is not supported on this platform\n");
+    return 0;
+}
+
+static void exitSocketLogger(Logger* lg)
+{
+}
+#else
+static void flushSocketAtExit(void)
+{
+    Logger* lg;
+
+    lockInstances();
+    for (lg = s_instances; lg != NULL; lg = lg->next) {
+        if (hasFlag(lg->loggers, kSocketLogger)) {
+            lock(lg);
+            sendSocket(lg, getCurrentMillis(), 1);
+            unlock(lg);
+        }
+    }
+    unlockInstances();
+}
+
+static int initSocketLogger(Logger* lg, const char* path, LogSocketType type)
+{
+    static int registered = 0; /* false */
+    struct sockaddr_un addr;
+    size_t len;
+    int ok = 0; /* false */
+
+    if (path == NULL) {
+        assert(0 && "path must not be NULL");
+        return 0;
+    }
+    len = strlen(path);
+    /* sun_path must keep the null character */
+    if (len == 0 || len >= sizeof(addr.sun_path) || len > kMaxSocketPathLen) {
+        assert(0 && "path is empty or exceeds the maximum number of characters");
+        return 0;
+    }
+
+    lock(lg);
+    if (lg->slog.connected) { /* reinit */
+        close(lg->slog.fd);
+        lg->slog.connected = 0;
+    }
+    if (lg->slog.buffer == NULL) {
+        if ((lg->slog.buffer = (char*) malloc(kSocketBufferSize)) == NULL) {
+            fprintf(stderr, "ERROR: logger: Failed to allocate a socket buffer\n");
+            goto cleanup;
+        }
+        lg->slog.used = 0;
+    }
+    memcpy(lg->slog.path, path, len);
+    lg->slog.path[len] = '\0';
+    lg->slog.type = type;
+    lg->slog.partial = 0;
+    lg->slog.hasConnected = 0;
+    lg->slog.retryTime = 0;
+    storeRelaxed(&lg->loggers, lg->loggers | kSocketLogger);
+    if (!registered) {
+        atexit(flushSocketAtExit);
+        registered = 1; /* true */
+    }
+    ok = 1; /* true */
+cleanup:
+    unlock(lg);
+    return ok;
+}
+
+static void exitSocketLogger(Logger* lg)
+{
+    char buf[kLineBufferSize];
+    size_t len;
+
+    lock(lg);
+    if (hasFlag(lg->loggers, kSocketLogger)) {
+        if ((len = formatRepeatSummary(&lg->slog.dedup, buf, sizeof(buf))) > 0) {
+            appendSocket(lg, buf, len, getCurrentMillis());
+        }
+        sendSocket(lg, getCurrentMillis(), 1);
+    }
+    if (lg->slog.connected) {
+        close(lg->slog.fd);
+        lg->slog.connected = 0;
+    }
+    free(lg->slog.buffer);
+    lg->slog.buffer = NULL;
+    lg->slog.used = 0;
+    storeRelaxed(&lg->loggers, lg->loggers & ~kSocketLogger);
+    unlock(lg);
+}
+#endif /* defined(_WIN32) || defined(_WIN64) */
+
+int logger_initSocketLogger(const char* path, LogSocketType type)
+{
+    init();
+    return initSocketLogger(&s_default, path, type);
+}
+
+void logger_exitSocketLogger(void)
+{
+    if (!s_initialized) {
+        return;
+    }
+    exitSocketLogger(&s_default);
+}
+
+/* Let the LOG_* macros through at the lowest level of the default logger, of any thread
+   and of the kept lines */
+static void updateEnabledLevel(void)
+{
+    int level;
+
+    for (level = LogLevel_TRACE; level < s_default.level; level++) {
+        if (s_threadLevels[level] > 0 || (s_keepSize > 0 && level >= s_keepLevel)) {
+            break;
+        }
+    }
+    storeRelaxed(&logger_enabledLevel, (LogLevel) level);
+    updateSites();
+}
+
+/* Resolve the flag the LOG_* macros check for a site */
+static void updateSite(LogSite* site)
+{
+    int enabled;
+
+    switch (site->mode) {
+        case LogSite_ON: enabled = LOGGER_SITE_ON; break;
+        case LogSite_OFF: enabled = LOGGER_SITE_OFF; break;
+        default:
+            enabled = (site->level >= loadRelaxed(&logger_enabledLevel)) ? LOGGER_SITE_ON : LOGGER_SITE_OFF;
+            break;
+    }
+    storeRelaxed(&site->enabled, enabled);
+}
+
+/* Resolve the flags of all sites. Called with the lock of the default logger held. */
+static void updateSites(void)
+{
+#if defined(LOGGER_HAVE_SITES)
+    LogSite* site;
+
+    for (site = __start_logger_sites; site < __stop_logger_sites; site++) {
+        updateSite(site);
+    }
+#endif /* defined(LOGGER_HAVE_SITES) */
+}
+
+void logger_setLevel(LogLevel level)
+{
+    init();
+    lock(&s_default);
+    storeRelaxed(&s_default.level, level);
+    updateEnabledLevel();
+    unlock(&s_default);
+}
+
+LogLevel logger_getLevel(void)
+{
+    return loadRelaxed(&s_default.level);
+}
+
+void logger_setThreadLevel(LogLevel level)
+{
+    if (level < LogLevel_TRACE || level > LogLevel_FATAL) {
+        assert(0 && "level is out of range");
+        return;
+    }
+    init();
+    lock(&s_default);
+    if (s_threadLevel != kNoThreadLevel) {
+        s_threadLevels[s_threadLevel]--;
+    }
+    s_threadLevel = level;
+    s_threadLevels[level]++;
+    updateEnabledLevel();
+    unlock(&s_default);
+#if !defined(_WIN32) && !defined(_WIN64)
+    pthread_setspecific(s_threadLevelKey, (void*) (size_t) (level + 1));
+#endif /* !defined(_WIN32) && !defined(_WIN64) */
+}
+
+void logger_clearThreadLevel(void)
+{
+    if (s_threadLevel == kNoThreadLevel) {
+        return;
+    }
+    lock(&s_default);
+    s_threadLevels[s_threadLevel]--;
+    s_threadLevel = kNoThreadLevel;
+    updateEnabledLevel();
+    unlock(&s_default);
+#if !defined(_WIN32) && !defined(_WIN64)
+    pthread_setspecific(s_threadLevelKey, NULL);
+#endif /* !defined(_WIN32) && !defined(_WIN64) */
+}
+
+#if !defined(_WIN32) && !defined(_WIN64)
+/* Called at the exit of a thread that has not cleared its level */
+static void clearThreadLevel(void* arg)
+{
+    int level = (int) (size_t) arg - 1;
+
+    lock(&s_default);
+    s_threadLevels[level]--;
+    updateEnabledLevel();
+    unlock(&s_default);
+}
+#endif /* !defined(_WIN32) && !defined(_WIN64) */
+
+int logger_getThreadLevel(LogLevel* level)
+{
+    if (s_threadLevel == kNoThreadLevel) {
+        return 0;
+    }
+    if (level != NULL) {
+        *level = (LogLevel) s_threadLevel;
+    }
+    return 1;
+}
+
+int logger_pushContext(const char* key, const char* value)
+{
+    Context* context = &s_context;
+    size_t keylen, valuelen, len;
+
+    if (key == NULL || value == NULL) {
+        assert(0 && "key and value must not be NULL");
+        return 0;
+    }
+    /* entries that do not fit are still counted so that pops stay paired */
+    if (context->depth >= kMaxContextDepth) {
+        context->depth++;
+        return 0;
+    }
+    len = context->len;
+    context->ends[context->depth++] = len;
+    keylen = strlen(key);
+    valuelen = strlen(value);
+    if ((len > 0) + keylen + 1 + valuelen > sizeof(context->text) - len) {
+        return 0;
+    }
+    if (len > 0) {
+        context->text[len++] = ' ';
+    }
+    memcpy(&context->text[len], key, keylen);
+    len += keylen;
+    context->text[len++] = '=';
+    memcpy(&context->text[len], value, valuelen);
+    context->len = len + valuelen;
+    return 1;
+}
+
+void logger_popContext(void)
+{
+    Context* context = &s_context;
+
+    if (context->depth == 0) {
+        assert(0 && "context is empty");
+        return;
+    }
+    if (--context->depth < kMaxContextDepth) {
+        context->len = context->ends[context->depth];
+    }
+}
+
+/* The level set for the thread overrides the level of every logger */
+static int isEnabled(Logger* lg, LogLevel level)
+{
+    int threadLevel = s_threadLevel;
+
+    if (threadLevel != kNoThreadLevel) {
+        return threadLevel <= (int) level;
+    }
+    return loadRelaxed(&lg->level) <= level;
+}
+
+int logger_isEnabled(LogLevel level)
+{
+    return isEnabled(&s_default, level);
+}
+
+/* Whether a line below the level is kept for an error of the thread */
+static int isKept(Logger* lg, LogLevel level)
+{
+    return lg == &s_default && loadRelaxed(&s_keepSize) > 0 && (int) level >= loadRelaxed(&s_keepLevel);
+}
+
+void logger_sanitize(int enabled)
+{
+    storeRelaxed(&s_sanitize, enabled != 0);
+}
+
+void logger_flushLevel(LogLevel level, int sync)
+{
+    storeRelaxed(&s_flushLevel, (int) level);
+    storeRelaxed(&s_syncFlush, sync != 0);
+}
+
+int logger_keepContext(LogLevel level, size_t size)
+{
+#if defined(_WIN32) || defined(_WIN64)
+    fprintf(stderr, "ERROR: logger: Keeping the context is not supported on this platform\n");
+    return 0;
+#else
+    if (level < LogLevel_TRACE || level > LogLevel_FATAL) {
+        assert(0 && "level is out of range");
+        return 0;
+    }
+    init();
+    lock(&s_default);
+    storeRelaxed(&s_keepLevel, (int) level);
+    storeRelaxed(&s_keepSize, size);
+    updateEnabledLevel();
+    unlock(&s_default);
+    return 1;
+#endif /* defined(_WIN32) || defined(_WIN64) */
+}
+
+void logger_autoFlush(long interval)
+{
+    storeRelaxed(&s_flushInterval, interval > 0 ? interval : 0);
+}
+
+void logger_deduplicate(int sinks)
+{
+    Logger* lg = &s_default;
+    char buf[kLineBufferSize];
+    size_t len;
+
+    init();
+    lock(lg);
+    storeRelaxed(&lg->clog.dedup.enabled, hasFlag(sinks, LogSink_CONSOLE));
+    if (!lg->clog.dedup.enabled && lg->clog.output != NULL) {
+        writeConsoleSummary(lg);
+    }
+    storeRelaxed(&lg->flog.dedup.enabled, hasFlag(sinks, LogSink_FILE));
+    if (!lg->flog.dedup.enabled && lg->flog.output != NULL) {
+        addFileSize(lg, writeRepeatSummary(lg->flog.output, &lg->flog.dedup));
+    }
+    storeRelaxed(&lg->slog.dedup.enabled, hasFlag(sinks, LogSink_SOCKET));
+    if (!lg->slog.dedup.enabled && lg->slog.buffer != NULL) {
+        len = formatRepeatSummary(&lg->slog.dedup, buf, sizeof(buf));
+        appendSocket(lg, buf, len, getCurrentMillis());
+    }
+    unlock(lg);
+}
+
+void logger_indexFile(long interval)
+{
+    Logger* lg = &s_default;
+
+    init();
+    lock(lg);
+    lg->flog.indexInterval = (interval > 0) ? interval : 0;
+    if (lg->flog.indexInterval == 0) {
+        closeIndexFile(lg);
+    }
+    unlock(lg);
+}
+
+#if defined(LOGGER_PROFILE)
+/* Write the count, the mean and the percentiles of a stage. The percentiles are the
+   upper bounds of their buckets. */
+static void dumpStage(FILE* output, const char* name, const unsigned long long* counts,
+        unsigned long long cycles)
+{
+    unsigned long long count = 0, sum = 0;
+    int i, p50 = -1, p99 = -1, max = 0;
+
+    for (i = 0; i < kProfileBuckets; i++) {
+        count += counts[i];
+    }
+    if (count == 0) {
+        return;
+    }
+    for (i = 0; i < kProfileBuckets; i++) {
+        if (counts[i] == 0) {
+            continue;
+        }
+        sum += counts[i];
+        if (p50 < 0 && sum * 2 >= count) {
+            p50 = i;
+        }
+        if (p99 < 0 && sum * 100 >= count * 99) {
+            p99 = i;
+        }
+        max = i;
+    }
+    fprintf(output, "%-8s %12lu %12lu %12lu %12lu %12lu\n", name, (unsigned long) count,
+            (unsigned long) (cycles / count), 2UL << p50, 2UL << p99, 2UL << max);
+    fprintf(output, "        ");
+    for (i = 0; i < kProfileBuckets; i++) {
+        if (counts[i] > 0) {
+            fprintf(output, " <%lu:%lu", 2UL << i, (unsigned long) counts[i]);
+        }
+    }
+    fprintf(output, "\n");
+}
+#endif /* defined(LOGGER_PROFILE) */
+
+int logger_dumpProfile(FILE* output)
+{
+#if defined(LOGGER_PROFILE)
+    static const char* const kStageNames[] = {
+        "clock", "thread", "prefix", "message", "lock", "rotate", "write", "flush", "sync",
+        "total"
+    };
+    Profile* total;
+    Profile* p;
+    int i;
+
+    if (output == NULL) {
+        assert(0 && "output must not be NULL");
+        return 0;
+    }
+    if ((total = (Profile*) calloc(1, sizeof(Profile))) == NULL) {
+        return 0;
+    }
+    init();
+    lock(&s_default);
+    addProfile(total, &s_exitedProfile);
+    for (p = s_profiles; p != NULL; p = p->next) {
+        addProfile(total, p);
+    }
+    unlock(&s_default);
+#if defined(HAVE_TSC)
+    fprintf(output, "%-8s %12s %12s %12s %12s %12s (cycles)\n", "stage", "count", "mean", "p50", "p99", "max");
+#else
+    fprintf(output, "%-8s %12s %12s %12s %12s %12s (nsec)\n", "stage", "count", "mean", "p50", "p99", "max");
+#endif /* defined(HAVE_TSC) */
+    for (i = 0; i < kStages; i++) {
+        dumpStage(output, kStageNames[i], total->counts[i], total->cycles[i]);
+    }
+    free(total);
+    return 1;
+#else
+    return 0;
+#endif /* defined(LOGGER_PROFILE) */
+}
+
+void logger_getStats(LogStats* stats)
+{
+    Logger* lg = &s_default;
+
+    if (stats == NULL) {
+        assert(0 && "stats must not be NULL");
+        return;
+    }
+    init();
+    lock(lg);
+    memset(stats, 0, sizeof(*stats));
+    stats->socketSentBytes = lg->slog.sentBytes;
+    stats->socketDroppedLines = lg->slog.droppedLines;
+    stats->socketReconnects = lg->slog.reconnects;
+    stats->fileBatchSize = lg->flog.batchSize;
+    stats->fileSyncs = lg->flog.syncs;
+    unlock(lg);
+#if !defined(_WIN32) && !defined(_WIN64)
+    pthread_mutex_lock(&lg->clog.mutex);
+    stats->consoleDroppedLines = lg->clog.droppedLines;
+    pthread_mutex_unlock(&lg->clog.mutex);
+#endif /* !defined(_WIN32) && !defined(_WIN64) */
+}
+
+void logger_flush()
+{
+    if (loadRelaxed(&s_default.loggers) == 0 || !s_initialized) {
+        assert(0 && "logger is not initialized");
+        return;
+    }
+    flushLogger(&s_default);
+}
+
+static void flushLogger(Logger* lg)
+{
+    char buf[kLineBufferSize];
+    size_t len;
+    int async;
+
+    lock(lg);
+    if (hasFlag(lg->loggers, kConsoleLogger)) {
+        writeConsoleSummary(lg);
+        flushConsole(lg);
+    }
+    async = lg->clog.async;
+    if (hasFlag(lg->loggers, kFileLogger) && lg->flog.output != NULL) {
+        addFileSize(lg, writeRepeatSummary(lg->flog.output, &lg->flog.dedup));
+        fflush(lg->flog.output);
+        lg->flog.batched = 0;
+        if (lg->flog.index != NULL) {
+            fflush(lg->flog.index);
+        }
+        if (isDurable(lg)) {
+            syncLogFile(lg);
+        }
+    }
+    if (hasFlag(lg->loggers, kFileLogger)) {
+        flushThreadFiles(lg);
+    }
+    if (hasFlag(lg->loggers, kSocketLogger)) {
+        if ((len = formatRepeatSummary(&lg->slog.dedup, buf, sizeof(buf))) > 0) {
+            appendSocket(lg, buf, len, getCurrentMillis());
+        }
+        sendSocket(lg, getCurrentMillis(), 1);
+    }
+    unlock(lg);
+    /* wait for the console without blocking the other loggers */
+    if (async) {
+        waitConsoleWriter(lg);
+    }
+}
+
+static char getLevelChar(LogLevel level)
+{
+    switch (level) {
+        case LogLevel_TRACE: return 'T';
+        case LogLevel_DEBUG: return 'D';
+        case LogLevel_INFO:  return 'I';
+        case LogLevel_WARN:  return 'W';
+        case LogLevel_ERROR: return 'E';
+        case LogLevel_FATAL: return 'F';
+        default: return ' ';
+    }
+}
+
+static const char* getLevelName(LogLevel level)
+{
+    switch (level) {
+        case LogLevel_TRACE: return "TRACE";
+        case LogLevel_DEBUG: return "DEBUG";
+        case LogLevel_INFO:  return "INFO";
+        case LogLevel_WARN:  return "WARN";
+        case LogLevel_ERROR: return "ERROR";
+        case LogLevel_FATAL: return "FATAL";
+        default: return "";
+    }
+}
+
+/* Get the offset of the local time from UTC in seconds */
+static long getUTCOffset(time_t sec, const struct tm* local)
+{
+    struct tm utc;
+    long offset;
+
+    gmtime_r(&sec, &utc);
+    offset = (local->tm_hour - utc.tm_hour) * 3600L + (local->tm_min - utc.tm_min) * 60L
+            + (local->tm_sec - utc.tm_sec);
+    if (local->tm_year != utc.tm_year) {
+        offset += (local->tm_year > utc.tm_year) ? 86400L : -86400L;
+    } else {
+        offset += (local->tm_yday - utc.tm_yday) * 86400L;
+    }
+    return offset;
+}
+
+/* Render the time in the style and return its length (at most 32) */
+static size_t formatTimestamp(const LogTime* time, int style, char* buf)
+{
+    time_t sec = time->sec; /* a necessary variable to avoid a runtime error on Windows */
+    struct tm calendar;
+    long usec = time->nsec / 1000, offset;
+    size_t len;
+    int i;
+
+    /* localtime_r() and strftime() only run once per second, style and thread */
+    if (s_timestampCache[style].sec != sec) {
+        switch (style) {
+            case kTimestampISO8601:
+                localtime_r(&sec, &calendar);
+                offset = getUTCOffset(sec, &calendar);
+                sprintf(s_timestampCache[style].zone, "%c%02d:%02d", (offset < 0) ? '-' : '+',
+                        (int) (labs(offset) / 3600 % 24), (int) (labs(offset) % 3600 / 60));
+                break;
+            case kTimestampUTC:
+                gmtime_r(&sec, &calendar);
+                strcpy(s_timestampCache[style].zone, "Z");
+                break;
+            default:
+                localtime_r(&sec, &calendar);
+                s_timestampCache[style].zone[0] = '\0';
+                break;
+        }
+        s_timestampCache[style].len = strftime(s_timestampCache[style].text,
+                sizeof(s_timestampCache[style].text),
+                (style == kTimestampDefault) ? "%y-%m-%d %H:%M:%S" : "%Y-%m-%dT%H:%M:%S", &calendar);
+        s_timestampCache[style].zonelen = strlen(s_timestampCache[style].zone);
+        s_timestampCache[style].sec = sec;
+    }
+    len = s_timestampCache[style].len;
+    memcpy(buf, s_timestampCache[style].text, len);
+    buf[len++] = '.';
+    for (i = 5; i >= 0; i--) {
+        buf[len + i] = (char) ('0' + usec % 10);
+        usec /= 10;
+    }
+    len += 6;
+    memcpy(&buf[len], s_timestampCache[style].zone, s_timestampCache[style].zonelen);
+    return len + s_timestampCache[style].zonelen;
+}
+
+static void getBackupFileName(const char* basename, unsigned char index,
+        char* backupname, size_t size)
+{
+    char indexname[5];
+
+    assert(size >= strlen(basename) + sizeof(indexname));
+
+    strncpy(backupname, basename, size);
+    if (index > 0) {
+        sprintf(indexname, ".%d", index);
+        strncat(backupname, indexname, strlen(indexname));
+    }
+}
+
+static int isFileExist(const char* filename)
+{
+    FILE* fp;
+
+    if ((fp = fopen(filename, "r")) == NULL) {
+        return 0;
+    } else {
+        fclose(fp);
+        return 1;
+    }
+}
+
+/* Remove a file. While the retention thread runs, the file is kept open and the
+   thread closes it, so that the blocks are released outside the lock. */
+static void discardFile(Logger* lg, const char* filename)
+{
+#if !defined(_WIN32) && !defined(_WIN64)
+    int fd = -1;
+
+    if (lg->retention.running && lg->retention.ndiscarded < kMaxDiscardedFiles) {
+        fd = open(filename, O_RDONLY);
+    }
+#endif /* !defined(_WIN32) && !defined(_WIN64) */
+    if (remove(filename) != 0) {
+        fprintf(stderr, "ERROR: logger: Failed to remove file: `%s`\n", filename);
+    }
+#if !defined(_WIN32) && !defined(_WIN64)
+    if (fd >= 0) {
+        lg->retention.discarded[lg->retention.ndiscarded++] = fd;
+        pthread_cond_signal(&lg->retention.wakeup);
+    }
+#endif /* !defined(_WIN32) && !defined(_WIN64) */
+}
+
+static void renameBackupFile(Logger* lg, const char* src, const char* dst)
+{
+    if (isFileExist(dst)) {
+        discardFile(lg, dst);
+    }
+    if (isFileExist(src)) {
+        if (rename(src, dst) != 0) {
+            fprintf(stderr, "ERROR: logger: Failed to rename file: `%s` -> `%s`\n", src, dst);
+        }
+    }
+}
+
+/* Shift the backups of a file and their indexes and make the file the first backup */
+static void rotateBackupFiles(Logger* lg, const char* filename, unsigned char maxBackupFiles)
+{
+    int i;
+    /* backup filename: <filename>.xxx[.idx] (xxx: 1-255) */
+    char src[kMaxThreadFileNameLen + 9], dst[kMaxThreadFileNameLen + 9]; /* with null character */
+
+    for (i = (int) maxBackupFiles; i > 0; i--) {
+        getBackupFileName(filename, i - 1, src, sizeof(src));
+        getBackupFileName(filename, i, dst, sizeof(dst));
+        renameBackupFile(lg, src, dst);
+        strcat(src, kIndexSuffix);
+        strcat(dst, kIndexSuffix);
+        renameBackupFile(lg, src, dst);
+    }
+}
+
+static int rotateLogFiles(Logger* lg)
+{
+    if (lg->flog.shared != NULL && !syncSharedFile(lg, 0)) {
+        return 0;
+    }
+    if (lg->flog.currentFileSize < lg->flog.maxFileSize) {
+        return lg->flog.output != NULL;
+    }
+    if (lg->flog.shared != NULL) {
+        /* one process rotates, the others wait and then follow the new generation */
+        if (!lockSharedFile(lg)) {
+            return lg->flog.output != NULL;
+        }
+        if (!syncSharedFile(lg, 1) || lg->flog.currentFileSize < lg->flog.maxFileSize) {
+            unlockSharedFile(lg);
+            return lg->flog.output != NULL;
+        }
+    }
+    syncClosingFile(lg);
+    closeLogFile(lg, lg->flog.output);
+    lg->flog.batched = 0;
+    closeIndexFile(lg);
+    rotateBackupFiles(lg, lg->flog.filename, lg->flog.maxBackupFiles);
+    lg->flog.output = openLogFile(lg, lg->flog.filename, &lg->flog.fd);
+    lg->flog.currentFileSize = (lg->flog.output != NULL) ? getFileSize(lg->flog.filename) : 0;
+    if (lg->flog.shared != NULL) {
+        lg->flog.shared->fileSize = lg->flog.currentFileSize;
+        lg->flog.generation = ++lg->flog.shared->generation;
+        unlockSharedFile(lg);
+    }
+    lg->retention.rotations++;
+#if !defined(_WIN32) && !defined(_WIN64)
+    if (lg->retention.running) {
+        lg->retention.pending = 1; /* true */
+        pthread_cond_signal(&lg->retention.wakeup);
+    }
+#endif /* !defined(_WIN32) && !defined(_WIN64) */
+    return lg->flog.output != NULL;
+}
+
+#if defined(_WIN32) || defined(_WIN64)
+int logger_retainFiles(unsigned long long maxTotalSize, long maxAge)
+{
+    fprintf(stderr, "ERROR: logger: Retention of backups is not supported on this platform\n");
+    return 0;
+}
+#else
+/* Find the newest backup that is past the total size or the age. It is dropped with
+   all older ones. Return 0 if every backup is kept. */
+static int findExpiredBackup(const char* filename, unsigned char maxBackupFiles,
+        unsigned long long maxTotalSize, long maxAge)
+{
+    char name[kMaxFileNameLen + 5];
+    unsigned long long totalSize = 0;
+    time_t now = time(NULL);
+    struct stat st;
+    int i;
+
+    for (i = 1; i <= (int) maxBackupFiles; i++) {
+        getBackupFileName(filename, i, name, sizeof(name));
+        if (stat(name, &st) != 0) {
+            continue;
+        }
+        totalSize += st.st_size;
+        if ((maxTotalSize > 0 && totalSize > maxTotalSize)
+                || (maxAge > 0 && now - st.st_mtime > maxAge)) {
+            return i;
+        }
+    }
+    return 0;
+}
+
+/* Drop the backups from the index on. Called with the lock held. */
+static void dropBackupFiles(Logger* lg, const char* filename, int first, unsigned char maxBackupFiles)
+{
+    char name[kMaxFileNameLen + 9];
+    int i;
+
+    for (i = (int) maxBackupFiles; i >= first; i--) {
+        getBackupFileName(filename, i, name, sizeof(name));
+        if (isFileExist(name)) {
+            discardFile(lg, name);
+        }
+        strcat(name, kIndexSuffix);
+        if (isFileExist(name)) {
+            discardFile(lg, name);
+        }
+    }
+}
+
+/* Wait for a rotation or for the next check of the ages. Return 0 when stopped. */
+static int waitRetention(Logger* lg)
+{
+    struct timespec deadline;
+
+    while (!lg->retention.pending && lg->retention.ndiscarded == 0) {
+        if (lg->retention.stopping) {
+            return 0;
+        }
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += kRetentionInterval;
+        if (pthread_cond_timedwait(&lg->retention.wakeup, &lg->mutex, &deadline) == ETIMEDOUT) {
+            lg->retention.pending = lg->retention.maxAge > 0;
+        }
+    }
+    return 1;
+}
+
+/* Find the expired backups outside the lock, and drop them under it unless a rotation
+   has shifted them meanwhile. Closing the removed files releases their blocks. */
+static void* runRetention(void* arg)
+{
+    Logger* lg = (Logger*) arg;
+    char filename[kMaxFileNameLen + 1];
+    int discarded[kMaxDiscardedFiles];
+    unsigned long long maxTotalSize;
+    unsigned long rotations;
+    unsigned char maxBackupFiles;
+    long maxAge;
+    int i, n, first;
+
+    lock(lg);
+    while (waitRetention(lg)) {
+        if ((n = lg->retention.ndiscarded) > 0) {
+            memcpy(discarded, lg->retention.discarded, n * sizeof(int));
+            lg->retention.ndiscarded = 0;
+            unlock(lg);
+            for (i = 0; i < n; i++) {
+                close(discarded[i]);
+            }
+            lock(lg);
+            continue;
+        }
+        lg->retention.pending = 0; /* false */
+        if (!hasFlag(lg->loggers, kFileLogger) || hasFlag(lg->flog.options, LogFileOption_PER_THREAD)) {
+            continue;
+        }
+        strcpy(filename, lg->flog.filename);
+        maxBackupFiles = lg->flog.maxBackupFiles;
+        maxTotalSize = lg->retention.maxTotalSize;
+        maxAge = lg->retention.maxAge;
+        rotations = (lg->flog.shared != NULL) ? lg->flog.shared->generation : lg->retention.rotations;
+        unlock(lg);
+        first = findExpiredBackup(filename, maxBackupFiles, maxTotalSize, maxAge);
+        lock(lg);
+        if (first == 0 || strcmp(filename, lg->flog.filename) != 0) {
+            continue;
+        }
+        if (lg->flog.shared != NULL) {
+            if (!lockSharedFile(lg)) {
+                continue;
+            }
+            if (lg->flog.shared->generation == rotations) {
+                dropBackupFiles(lg, filename, first, maxBackupFiles);
+            } else {
+                lg->retention.pending = 1; /* true */
+            }
+            unlockSharedFile(lg);
+        } else if (lg->retention.rotations == rotations) {
+            dropBackupFiles(lg, filename, first, maxBackupFiles);
+        } else {
+            lg->retention.pending = 1; /* true */
+        }
+    }
+    for (i = 0; i < lg->retention.ndiscarded; i++) {
+        close(lg->retention.discarded[i]);
+    }
+    lg->retention.ndiscarded = 0;
+    unlock(lg);
+    return NULL;
+}
+
+/* Stop the retention thread. Called with the lock held, which the thread needs to stop. */
+static void stopRetention(Logger* lg)
+{
+    if (!lg->retention.running) {
+        return;
+    }
+    lg->retention.stopping = 1; /* true */
+    pthread_cond_signal(&lg->retention.wakeup);
+    unlock(lg);
+    pthread_join(lg->retention.thread, NULL);
+    lock(lg);
+    lg->retention.running = 0; /* false */
+    lg->retention.stopping = 0; /* false */
+}
+
+int logger_retainFiles(unsigned long long maxTotalSize, long maxAge)
+{
+    Logger* lg = &s_default;
+    int ok = 1; /* true */
+
+    init();
+    lock(lg);
+    lg->retention.maxTotalSize = maxTotalSize;
+    lg->retention.maxAge = (maxAge > 0) ? maxAge : 0;
+    if (lg->retention.maxTotalSize == 0 && lg->retention.maxAge == 0) {
+        stopRetention(lg);
+    } else if (!lg->retention.running) {
+        if (pthread_create(&lg->retention.thread, NULL, runRetention, lg) == 0) {
+            lg->retention.running = 1; /* true */
+        } else {
+            fprintf(stderr, "ERROR: logger: Failed to start a retention thread\n");
+            ok = 0; /* false */
+        }
+    }
+    if (lg->retention.running) {
+        lg->retention.pending = 1; /* true */
+        pthread_cond_signal(&lg->retention.wakeup);
+    }
+    unlock(lg);
+    return ok;
+}
+#endif /* defined(_WIN32) || defined(_WIN64) */
+
+/* Write the decimal representation of a value and return its length */
+static size_t formatLong(char* buf, long value)
+{
+    char digits[24];
+    unsigned long v = (value < 0) ? -(unsigned long) value : (unsigned long) value;
+    size_t n = 0, len = 0;
+
+    do {
+        digits[n++] = (char) ('0' + v % 10);
+        v /= 10;
+    } while (v > 0);
+    if (value < 0) {
+        buf[len++] = '-';
+    }
+    while (n > 0) {
+        buf[len++] = digits[--n];
+    }
+    return len;
+}
+
+/* Render "level timestamp threadid file:line: context " and return its length */
+static size_t formatPrefix(char* buf, size_t size, const LogRecord* rec)
+{
+    size_t len = 0, filelen = strlen(rec->file);
+
+    assert(size >= 80);
+
+    buf[len++] = getLevelChar(rec->level);
+    buf[len++] = ' ';
+    len += formatTimestamp(&rec->time, kTimestampDefault, &buf[len]);
+    buf[len++] = ' ';
+    len += formatLong(&buf[len], rec->threadID);
+    buf[len++] = ' ';
+    if (filelen > size - len - 16) {
+        filelen = size - len - 16;
+    }
+    memcpy(&buf[len], rec->file, filelen);
+    len += filelen;
+    buf[len++] = ':';
+    len += formatLong(&buf[len], rec->line);
+    buf[len++] = ':';
+    buf[len++] = ' ';
+    return len;
+}
+
+/* Render the fields of ops [begin, end) of the format and return their length */
+static size_t renderPattern(const Pattern* pattern, size_t begin, size_t end, const LogRecord* rec,
+        char* buf, size_t size)
+{
+    const PatternOp* op;
+    const char* src;
+    char field[40];
+    char* dst;
+    size_t i, n, len = 0;
+
+    for (i = begin; i < end; i++) {
+        op = &pattern->ops[i];
+        /* short fields are rendered in place unless they may not fit */
+        dst = (size - len >= sizeof(field)) ? &buf[len] : field;
+        src = dst;
+        switch (op->type) {
+            case kOpLiteral:
+                if (op->len == 1 && dst != field) {
+                    *dst = pattern->literals[op->offset];
+                    len++;
+                    continue;
+                }
+                src = &pattern->literals[op->offset];
+                n = op->len;
+                break;
+            case kOpLevel:
+                dst[0] = getLevelChar(rec->level);
+                n = 1;
+                break;
+            case kOpLevelName:
+                src = getLevelName(rec->level);
+                n = strlen(src);
+                break;
+            case kOpDate:
+                n = formatTimestamp(&rec->time, op->style, dst);
+                break;
+            case kOpThread:
+                n = formatLong(dst, rec->threadID);
+                break;
+            case kOpFile:
+                src = rec->file;
+                n = strlen(src);
+                break;
+            case kOpLine:
+                n = formatLong(dst, rec->line);
+                break;
+            case kOpContext:
+                src = rec->context;
+                n = rec->contextlen;
+                break;
+            case kOpDefaultPrefix: /* always the first operation */
+                len += formatPrefix(&buf[len], size - len, rec);
+                continue;
+            case kOpPrefixContext:
+                if (rec->contextlen > 0 && rec->contextlen < size - len) {
+                    memcpy(&buf[len], rec->context, rec->contextlen);
+                    len += rec->contextlen;
+                    buf[len++] = ' ';
+                }
+                continue;
+            default:
+                continue;
+        }
+        if (src != &buf[len]) {
+            if (n > size - len) {
+                n = size - len;
+            }
+            memcpy(&buf[len], src, n);
+        }
+        len += n;
+    }
+    return len;
+}
+
+/* Append a field operation to the format */
+static PatternOp* addPatternOp(Pattern* pattern, int type)
+{
+    PatternOp* op;
+
+    if (pattern->nops == kMaxPatternOps) {
+        return NULL;
+    }
+    op = &pattern->ops[pattern->nops++];
+    op->type = type;
+    op->style = kTimestampDefault;
+    op->offset = pattern->literalsLen;
+    op->len = 0;
+    return op;
+}
+
+/* Return whether the format has the field of a conversion character */
+static int hasField(const char* format, char conversion)
+{
+    const char* p;
+
+    for (p = format; (p = strchr(p, '%')) != NULL && p[1] != '\0'; p += 2) {
+        if (p[1] == conversion) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Compile the format into the list of operations rendering a line */
+static int compilePattern(const char* format, Pattern* pattern)
+{
+    const char* p;
+    PatternOp* op;
+    PatternOp* literal = NULL;
+    int messages = 0;
+
+    memset(pattern, 0, sizeof(*pattern));
+    pattern->dateStyle = -1;
+    p = format;
+    /* the layout of the default format has a specialized renderer */
+    if (strncmp(format, kDefaultPrefix, sizeof(kDefaultPrefix) - 1) == 0) {
+        addPatternOp(pattern, kOpDefaultPrefix);
+        /* the context follows the prefix unless the format places it */
+        if (!hasField(format, 'X')) {
+            addPatternOp(pattern, kOpPrefixContext);
+        }
+        pattern->dateStyle = kTimestampDefault;
+        p += sizeof(kDefaultPrefix) - 1;
+    }
+    for (; *p != '\0'; p++) {
+        if (*p == '%' && p[1] != '%') {
+            literal = NULL;
+            if ((op = addPatternOp(pattern, kOpLiteral)) == NULL) {
+                goto error;
+            }
+            switch (*++p) {
+                case 'L': op->type = kOpLevel; break;
+                case 'V': op->type = kOpLevelName; break;
+                case 't': op->type = kOpThread; break;
+                case 'f': op->type = kOpFile; break;
+                case 'l': op->type = kOpLine; break;
+                case 'X': op->type = kOpContext; break;
+                case 'm':
+                    op->type = kOpMessage;
+                    pattern->messageOp = pattern->nops - 1;
+                    messages++;
+                    break;
+                case 'D':
+                    op->type = kOpDate;
+                    if (strncmp(p, "D{iso8601}", 10) == 0) {
+                        op->style = kTimestampISO8601;
+                        p += 9;
+                    } else if (strncmp(p, "D{utc}", 6) == 0) {
+                        op->style = kTimestampUTC;
+                        p += 5;
+                    } else if (p[1] == '{') {
+                        goto error;
+                    }
+                    if (pattern->dateStyle < 0) {
+                        pattern->dateStyle = op->style;
+                    }
+                    break;
+                default:
+                    goto error;
+            }
+        } else {
+            if (*p == '%') { /* %% */
+                p++;
+            }
+            if (literal == NULL && (literal = addPatternOp(pattern, kOpLiteral)) == NULL) {
+                goto error;
+            }
+            if (pattern->literalsLen == sizeof(pattern->literals)) {
+                goto error;
+            }
+            pattern->literals[pattern->literalsLen++] = *p;
+            literal->len++;
+        }
+    }
+    if (messages != 1) {
+        goto error;
+    }
+    if (pattern->dateStyle < 0) {
+        pattern->dateStyle = kTimestampDefault;
+    }
+    return 1;
+error:
+    fprintf(stderr, "ERROR: logger: Invalid format: `%s`\n", format);
+    return 0;
+}
+
+int logger_setFormat(const char* format)
+{
+    Pattern* pattern;
+
+    if (format == NULL) {
+        assert(0 && "format must not be NULL");
+        return 0;
+    }
+
+    if ((pattern = (Pattern*) malloc(sizeof(Pattern))) == NULL) {
+        fprintf(stderr, "ERROR: logger: Failed to allocate memory for the format\n");
+        return 0;
+    }
+    if (!compilePattern(format, pattern)) {
+        free(pattern);
+        return 0;
+    }
+    init();
+    lock(&s_default);
+    /* the lines being rendered keep using the current format */
+    pattern->next = s_patterns;
+    s_patterns = pattern;
+    storeRelease(&s_pattern, pattern);
+    unlock(&s_default);
+    return 1;
+}
+
+/* FNV-1a over the call site and the message */
+static unsigned long long hashRecord(LogLevel level, const char* file, int line,
+        const char* message, size_t len)
+{
+    unsigned long long hash = 14695981039346656037ULL;
+    size_t i;
+
+    hash = (hash ^ (unsigned long long) level) * 1099511628211ULL;
+    hash = (hash ^ (unsigned long long) (size_t) file) * 1099511628211ULL;
+    hash = (hash ^ (unsigned long long) line) * 1099511628211ULL;
+    for (i = 0; i < len; i++) {
+        hash = (hash ^ (unsigned char) message[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+/* Render the summary of the suppressed repeats and return its length */
+static size_t formatRepeatSummary(Dedup* dedup, char* buf, size_t size)
+{
+    const Pattern* pattern = loadAcquire(&s_pattern);
+    LogRecord rec;
+    char first[40], last[40];
+    size_t len;
+    long count = dedup->count;
+
+    assert(size >= 512);
+
+    if (count == 0) {
+        return 0;
+    }
+    dedup->count = 0;
+    first[formatTimestamp(&dedup->first, pattern->dateStyle, first)] = '\0';
+    last[formatTimestamp(&dedup->last, pattern->dateStyle, last)] = '\0';
+    rec.level = dedup->level;
+    rec.file = dedup->file;
+    rec.line = dedup->line;
+    rec.threadID = dedup->threadID;
+    rec.context = "";
+    rec.contextlen = 0;
+    rec.time = dedup->last;
+    len = renderPattern(pattern, 0, pattern->messageOp, &rec, buf, size - 256);
+    len += sprintf(&buf[len], "last message repeated %ld times (first %s, last %s)",
+            count, first, last);
+    len += renderPattern(pattern, pattern->messageOp + 1, pattern->nops, &rec, &buf[len],
+            size - len - 1);
+    buf[len++] = '\n';
+    return len;
+}
+
+static long writeRepeatSummary(FILE* fp, Dedup* dedup)
+{
+    char buf[kLineBufferSize];
+    size_t len;
+
+    if ((len = formatRepeatSummary(dedup, buf, sizeof(buf))) == 0) {
+        return 0;
+    }
+    return (long) fwrite(buf, 1, len, fp);
+}
+
+/* Count the record if it repeats the previous one */
+static int isRepeat(Dedup* dedup, const LogRecord* rec)
+{
+    if (rec->hash != dedup->hash || rec->file != dedup->file || rec->line != dedup->line) {
+        return 0;
+    }
+    if (dedup->count++ == 0) {
+        dedup->first = rec->time;
+    }
+    dedup->last = rec->time;
+    dedup->threadID = rec->threadID;
+    return 1;
+}
+
+static void setLastRecord(Dedup* dedup, const LogRecord* rec)
+{
+    dedup->hash = rec->hash;
+    dedup->level = rec->level;
+    dedup->file = rec->file;
+    dedup->line = rec->line;
+}
+
+static long vflog(FILE* fp, Dedup* dedup, const LogRecord* rec, unsigned long long* flushedTime)
+{
+    long totalsize = 0;
+    long interval = loadRelaxed(&s_flushInterval);
+
+    if (dedup->enabled) {
+        if (isRepeat(dedup, rec)) {
+            /* report long runs of repeats at every flush interval */
+            if (interval > 0 && rec->currentTime - *flushedTime > interval) {
+                totalsize += writeRepeatSummary(fp, dedup);
+                fflush(fp);
+                *flushedTime = rec->currentTime;
+            }
+            return totalsize;
+        }
+        totalsize += writeRepeatSummary(fp, dedup);
+        setLastRecord(dedup, rec);
+    }
+    totalsize += (long) fwrite(rec->text, 1, rec->len, fp);
+    if (interval > 0) {
+        if (rec->currentTime - *flushedTime > interval) {
+            fflush(fp);
+            *flushedTime = rec->currentTime;
+        }
+    }
+    return totalsize;
+}
+
+/* Write a line to the console or queue it for the writer thread */
+static void writeConsole(Logger* lg, const char* text, size_t len, LogLevel level)
+{
+    if (lg->clog.async) {
+        appendConsole(lg, text, len, level);
+    } else if (lg->clog.colored) {
+        fwrite(kLevelColors[level], 1, kLevelColorLens[level], lg->clog.output);
+        fwrite(text, 1, len - 1, lg->clog.output);
+        fwrite(kColorReset, 1, sizeof(kColorReset) - 1, lg->clog.output);
+    } else {
+        fwrite(text, 1, len, lg->clog.output);
+    }
+}
+
+static void writeConsoleSummary(Logger* lg)
+{
+    char buf[kLineBufferSize];
+    LogLevel level = lg->clog.dedup.level;
+    size_t len;
+
+    if ((len = formatRepeatSummary(&lg->clog.dedup, buf, sizeof(buf))) > 0) {
+        writeConsole(lg, buf, len, level);
+    }
+}
+
+/* Flush the console unless the writer thread writes it */
+static void flushConsole(Logger* lg)
+{
+    if (!lg->clog.async) {
+        fflush(lg->clog.output);
+    }
+}
+
+static void vclog(Logger* lg, const LogRecord* rec)
+{
+    long interval = loadRelaxed(&s_flushInterval);
+
+    if (lg->clog.dedup.enabled) {
+        if (isRepeat(&lg->clog.dedup, rec)) {
+            /* report long runs of repeats at every flush interval */
+            if (interval > 0 && rec->currentTime - lg->clog.flushedTime > interval) {
+                writeConsoleSummary(lg);
+                flushConsole(lg);
+                lg->clog.flushedTime = rec->currentTime;
+            }
+            return;
+        }
+        writeConsoleSummary(lg);
+        setLastRecord(&lg->clog.dedup, rec);
+    }
+    writeConsole(lg, rec->text, rec->len, rec->level);
+    if ((int) rec->level >= loadRelaxed(&s_flushLevel)) {
+        flushConsole(lg);
+    } else if (interval > 0 && rec->currentTime - lg->clog.flushedTime > interval) {
+        flushConsole(lg);
+        lg->clog.flushedTime = rec->currentTime;
+    }
+}
+
+#if defined(_WIN32) || defined(_WIN64)
+static void sendSocket(Logger* lg, unsigned long long now, int force)
+{
+}
+
+static void appendSocket(Logger* lg, const char* text, size_t len, unsigned long long now)
+{
+}
+#else
+static int connectSocket(Logger* lg)
+{
+    struct sockaddr_un addr;
+    int fd;
+#if defined(SO_NOSIGPIPE)
+    int on = 1;
+#endif /* defined(SO_NOSIGPIPE) */
+
+    fd = socket(AF_UNIX, (lg->slog.type == LogSocket_STREAM) ? SOCK_STREAM : SOCK_DGRAM, 0);
+    if (fd < 0) {
+        return 0;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, lg->slog.path, strlen(lg->slog.path)); /* checked to fit with its null */
+    /* a slow collector must never block the logging threads */
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+#if defined(SO_NOSIGPIPE)
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif /* defined(SO_NOSIGPIPE) */
+    if (connect(fd, (struct sockaddr*) &addr, sizeof(addr)) != 0) {
+        close(fd);
+        return 0;
+    }
+    lg->slog.fd = fd;
+    lg->slog.connected = 1; /* true */
+    if (lg->slog.hasConnected) {
+        lg->slog.reconnects++;
+    }
+    lg->slog.hasConnected = 1; /* true */
+    return 1;
+}
+
+static void consumeSocketBuffer(Logger* lg, size_t len)
+{
+    memmove(lg->slog.buffer, &lg->slog.buffer[len], lg->slog.used - len);
+    lg->slog.used -= len;
+}
+
+static void disconnectSocket(Logger* lg, unsigned long long now)
+{
+    char* eol;
+
+    close(lg->slog.fd);
+    lg->slog.connected = 0; /* false */
+    lg->slog.retryTime = now + kSocketRetryInterval;
+    /* a new connection must not start with the tail of a line */
+    if (lg->slog.partial && (eol = (char*) memchr(lg->slog.buffer, '\n', lg->slog.used)) != NULL) {
+        consumeSocketBuffer(lg, eol - lg->slog.buffer + 1);
+        lg->slog.droppedLines++;
+    }
+    lg->slog.partial = 0; /* false */
+}
+
+/* Get the length of the whole lines at the front of the buffer that fit in one datagram */
+static size_t getDatagramSize(Logger* lg)
+{
+    size_t len = 0;
+    char* eol;
+
+    while (len < lg->slog.used
+            && (eol = (char*) memchr(&lg->slog.buffer[len], '\n', lg->slog.used - len)) != NULL) {
+        if ((size_t) (eol - lg->slog.buffer) + 1 > kSocketBatchSize && len > 0) {
+            break;
+        }
+        len = eol - lg->slog.buffer + 1;
+    }
+    return len;
+}
+
+static void sendSocket(Logger* lg, unsigned long long now, int force)
+{
+    size_t len;
+    ssize_t size;
+#if defined(MSG_NOSIGNAL)
+    const int flags = MSG_NOSIGNAL;
+#else
+    const int flags = 0;
+#endif /* defined(MSG_NOSIGNAL) */
+
+    if (lg->slog.used == 0) {
+        return;
+    }
+    if (!lg->slog.connected) {
+        if (!force && now < lg->slog.retryTime) {
+            return;
+        }
+        if (!connectSocket(lg)) {
+            lg->slog.retryTime = now + kSocketRetryInterval;
+            return;
+        }
+    }
+    while (lg->slog.used > 0) {
+        len = (lg->slog.type == LogSocket_STREAM) ? lg->slog.used : getDatagramSize(lg);
+        if (len == 0) {
+            break;
+        }
+        size = send(lg->slog.fd, lg->slog.buffer, len, flags);
+        if (size < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS) {
+                break; /* keep the lines until the collector catches up */
+            } else if (errno == EMSGSIZE) {
+                consumeSocketBuffer(lg, len);
+                lg->slog.droppedLines++;
+                continue;
+            }
+            disconnectSocket(lg, now);
+            break;
+        }
+        lg->slog.sentBytes += size;
+        lg->slog.partial = (lg->slog.buffer[size - 1] != '\n');
+        consumeSocketBuffer(lg, size);
+    }
+}
+
+static void appendSocket(Logger* lg, const char* text, size_t len, unsigned long long now)
+{
+    if (len == 0) {
+        return;
+    }
+    if (lg->slog.used + len > kSocketBufferSize) {
+        sendSocket(lg, now, 0);
+    }
+    if (lg->slog.used + len > kSocketBufferSize) {
+        lg->slog.droppedLines++;
+        return;
+    }
+    memcpy(&lg->slog.buffer[lg->slog.used], text, len);
+    lg->slog.used += len;
+}
+#endif /* defined(_WIN32) || defined(_WIN64) */
+
+static void vslog(Logger* lg, const LogRecord* rec)
+{
+    char buf[kLineBufferSize];
+    long interval = loadRelaxed(&s_flushInterval);
+
+    if (lg->slog.dedup.enabled) {
+        if (isRepeat(&lg->slog.dedup, rec)) {
+            /* report long runs of repeats at every flush interval */
+            if (interval > 0 && rec->currentTime - lg->slog.flushedTime > interval) {
+                appendSocket(lg, buf, formatRepeatSummary(&lg->slog.dedup, buf, sizeof(buf)), rec->currentTime);
+                sendSocket(lg, rec->currentTime, 0);
+                lg->slog.flushedTime = rec->currentTime;
+            }
+            return;
+        }
+        appendSocket(lg, buf, formatRepeatSummary(&lg->slog.dedup, buf, sizeof(buf)), rec->currentTime);
+        setLastRecord(&lg->slog.dedup, rec);
+    }
+    appendSocket(lg, rec->text, rec->len, rec->currentTime);
+    if (lg->slog.used >= kSocketBatchSize || (int) rec->level >= loadRelaxed(&s_flushLevel)
+            || (interval > 0 && rec->currentTime - lg->slog.flushedTime > interval)) {
+        sendSocket(lg, rec->currentTime, 0);
+        lg->slog.flushedTime = rec->currentTime;
+    }
+}
+
+/* Open the file of this thread, or reopen it after the file logger has been reconfigured */
+static ThreadFile* openThreadFile(Logger* lg)
+{
+    ThreadFile* tf = s_threadFile;
+
+    lock(lg);
+    if (tf == NULL) {
+        if ((tf = (ThreadFile*) calloc(1, sizeof(ThreadFile))) == NULL) {
+            unlock(lg);
+            return NULL;
+        }
+        tf->next = lg->flog.threadFiles;
+        lg->flog.threadFiles = tf;
+        s_threadFile = tf;
+#if !defined(_WIN32) && !defined(_WIN64)
+        pthread_setspecific(s_threadFileKey, tf);
+#endif /* !defined(_WIN32) && !defined(_WIN64) */
+    } else if (tf->output != NULL) {
+        writeRepeatSummary(tf->output, &tf->dedup);
+        closeLogFile(lg, tf->output);
+    }
+    memset(&tf->dedup, 0, sizeof(tf->dedup));
+    sprintf(tf->filename, "%s.t%ld", lg->flog.filename, getCurrentThreadID());
+    tf->maxFileSize = lg->flog.maxFileSize;
+    tf->maxBackupFiles = lg->flog.maxBackupFiles;
+    tf->generation = lg->flog.threadGeneration;
+    if ((tf->output = openLogFile(lg, tf->filename, &tf->fd)) != NULL) {
+        tf->currentFileSize = getFileSize(tf->filename);
+    }
+    unlock(lg);
+    return tf;
+}
+
+/* Called at the exit of a thread that has a file, which only the default logger writes */
+static void closeThreadFile(void* arg)
+{
+    Logger* lg = &s_default;
+    ThreadFile* tf = (ThreadFile*) arg;
+    ThreadFile** p;
+
+    lock(lg);
+    for (p = &lg->flog.threadFiles; *p != NULL; p = &(*p)->next) {
+        if (*p == tf) {
+            *p = tf->next;
+            break;
+        }
+    }
+    if (tf->output != NULL) {
+        writeRepeatSummary(tf->output, &tf->dedup);
+        closeLogFile(lg, tf->output);
+    }
+    unlock(lg);
+    free(tf);
+}
+
+/* Flush the files of all threads. The owners may keep writing to them. */
+static void flushThreadFiles(Logger* lg)
+{
+    ThreadFile* tf;
+
+    for (tf = lg->flog.threadFiles; tf != NULL; tf = tf->next) {
+        if (tf->output != NULL) {
+            fflush(tf->output);
+        }
+    }
+}
+
+/* Write to the file of this thread without taking the lock except to open or rotate it */
+static void writeThreadFile(Logger* lg, const LogRecord* rec)
+{
+    ThreadFile* tf = s_threadFile;
+    int options;
+
+    if (tf == NULL || tf->generation != loadRelaxed(&lg->flog.threadGeneration)) {
+        if ((tf = openThreadFile(lg)) == NULL) {
+            return;
+        }
+    }
+    if (tf->output != NULL && tf->currentFileSize >= tf->maxFileSize) {
+        /* other threads flush the file under the lock */
+        lock(lg);
+        closeLogFile(lg, tf->output);
+        rotateBackupFiles(lg, tf->filename, tf->maxBackupFiles);
+        tf->output = openLogFile(lg, tf->filename, &tf->fd);
+        tf->currentFileSize = 0;
+        unlock(lg);
+    }
+    if (tf->output == NULL) {
+        return;
+    }
+    if (tf->dedup.enabled != loadRelaxed(&lg->flog.dedup.enabled)) {
+        tf->currentFileSize += writeRepeatSummary(tf->output, &tf->dedup);
+        tf->dedup.enabled = !tf->dedup.enabled;
+    }
+    tf->currentFileSize += vflog(tf->output, &tf->dedup, rec, &tf->flushedTime);
+    options = loadRelaxed(&lg->flog.options);
+    if (hasFlag(options, LogFileOption_SYNC_GROUP) || (hasFlag(options, LogFileOption_SYNC_PERIODIC)
+            && rec->currentTime - tf->syncedTime >= kSyncInterval)) {
+        flushFile(tf->output, tf->fd, 1);
+        tf->syncedTime = rec->currentTime;
+    } else if ((int) rec->level >= loadRelaxed(&s_flushLevel)) {
+        flushFile(tf->output, tf->fd, loadRelaxed(&s_syncFlush));
+    }
+}
+
+/* Get a buffer for a line longer than kLineBufferSize. Lines up to kMaxLongLineSize
+   reuse the buffer of the thread, grown in powers of two, so that logging does not
+   allocate once it has seen its longest line. */
+static char* allocLine(int buffer, size_t size)
+{
+#if !defined(_WIN32) && !defined(_WIN64)
+    size_t capacity;
+
+    if (size <= s_lineBuffers[buffer].size) {
+        return s_lineBuffers[buffer].data;
+    }
+    if (size <= kMaxLongLineSize) {
+        for (capacity = kLineBufferSize * 4; capacity < size; capacity *= 2) {
+        }
+        free(s_lineBuffers[buffer].data);
+        s_lineBuffers[buffer].size = 0;
+        if ((s_lineBuffers[buffer].data = (char*) malloc(capacity)) != NULL) {
+            s_lineBuffers[buffer].size = capacity;
+        }
+        pthread_setspecific(s_lineBufferKeys[buffer], s_lineBuffers[buffer].data);
+        return s_lineBuffers[buffer].data;
+    }
+#endif /* !defined(_WIN32) && !defined(_WIN64) */
+    return (char*) malloc(size);
+}
+
+static void freeLine(int buffer, char* text)
+{
+#if !defined(_WIN32) && !defined(_WIN64)
+    if (text == s_lineBuffers[buffer].data) {
+        return;
+    }
+#endif /* !defined(_WIN32) && !defined(_WIN64) */
+    free(text);
+}
+
+static int isControlChar(unsigned char c)
+{
+    return c < 0x20 || c == 0x7f;
+}
+
+/* Return the index of the first control character, or len if there is none */
+static size_t findControlCharScalar(const char* s, size_t len)
+{
+    size_t i;
+
+    for (i = 0; i < len && !isControlChar((unsigned char) s[i]); i++) {
+    }
+    return i;
+}
+
+#if defined(HAVE_SSE2)
+static int countTrailingZeros(unsigned int mask)
+{
+#if defined(_MSC_VER)
+    unsigned long i;
+
+    _BitScanForward(&i, mask);
+    return (int) i;
+#else
+    return __builtin_ctz(mask);
+#endif /* defined(_MSC_VER) */
+}
+
+/* Test 16 bytes at a time: c <= 0x1f is min(c, 0x1f) == c on unsigned bytes */
+static size_t findControlCharSSE2(const char* s, size_t len)
+{
+    const __m128i limit = _mm_set1_epi8(0x1f);
+    const __m128i del = _mm_set1_epi8(0x7f);
+    __m128i v;
+    unsigned int mask;
+    size_t i;
+
+    for (i = 0; i + 16 <= len; i += 16) {
+        v = _mm_loadu_si128((const __m128i*) &s[i]);
+        mask = (unsigned int) _mm_movemask_epi8(_mm_or_si128(
+                _mm_cmpeq_epi8(_mm_min_epu8(v, limit), v), _mm_cmpeq_epi8(v, del)));
+        if (mask != 0) {
+            return i + countTrailingZeros(mask);
+        }
+    }
+    return i + findControlCharScalar(&s[i], len - i);
+}
+#endif /* defined(HAVE_SSE2) */
+
+#if defined(HAVE_AVX2)
+__attribute__((target("avx2")))
+static size_t findControlCharAVX2(const char* s, size_t len)
+{
+    const __m256i limit = _mm256_set1_epi8(0x1f);
+    const __m256i del = _mm256_set1_epi8(0x7f);
+    __m256i v;
+    unsigned int mask;
+    size_t i;
+
+    for (i = 0; i + 32 <= len; i += 32) {
+        v = _mm256_loadu_si256((const __m256i*) &s[i]);
+        mask = (unsigned int) _mm256_movemask_epi8(_mm256_or_si256(
+                _mm256_cmpeq_epi8(_mm256_min_epu8(v, limit), v), _mm256_cmpeq_epi8(v, del)));
+        if (mask != 0) {
+            return i + countTrailingZeros(mask);
+        }
+    }
+    return i + findControlCharSSE2(&s[i], len - i);
+}
+#endif /* defined(HAVE_AVX2) */
+
+static size_t findControlChar(const char* s, size_t len)
+{
+#if defined(HAVE_AVX2)
+    static int avx2 = -1;
+
+    if (avx2 < 0) {
+        avx2 = __builtin_cpu_supports("avx2") != 0;
+    }
+    if (avx2) {
+        return findControlCharAVX2(s, len);
+    }
+#endif /* defined(HAVE_AVX2) */
+#if defined(HAVE_SSE2)
+    return findControlCharSSE2(s, len);
+#else
+    return findControlCharScalar(s, len);
+#endif /* defined(HAVE_SSE2) */
+}
+
+/* Write the escape sequence of a control character and return its length */
+static size_t escapeControlChar(unsigned char c, char* buf)
+{
+    buf[0] = '\\';
+    switch (c) {
+        case '\n': buf[1] = 'n'; return 2;
+        case '\r': buf[1] = 'r'; return 2;
+        case '\t': buf[1] = 't'; return 2;
+        default:
+            buf[1] = 'x';
+            memcpy(&buf[2], &kHexPairs[c * 2], 2);
+            return 4;
+    }
+}
+
+/* Escape the control characters of the message so that it cannot forge lines.
+   Return the line holding the escaped message, or text if it has none. */
+static char* escapeMessage(char* text, size_t prefixlen, size_t* msglen, size_t suffixlen)
+{
+    const char* msg = &text[prefixlen];
+    size_t len = *msglen, i, n, escapedlen;
+    char* escaped;
+
+    if ((i = findControlChar(msg, len)) == len) {
+        return text;
+    }
+    escapedlen = len;
+    for (n = i; n < len; n++) {
+        if (isControlChar((unsigned char) msg[n])) {
+            escapedlen += (msg[n] == '\n' || msg[n] == '\r' || msg[n] == '\t') ? 1 : 3;
+        }
+    }
+    if ((escaped = allocLine(kEscapedLine, prefixlen + escapedlen + suffixlen + 1)) == NULL) {
+        /* blank them out rather than let them through */
+        for (n = i; n < len; n++) {
+            if (isControlChar((unsigned char) msg[n])) {
+                text[prefixlen + n] = ' ';
+            }
+        }
+        return text;
+    }
+    memcpy(escaped, text, prefixlen + i);
+    for (n = prefixlen + i; i < len; i++) {
+        if (isControlChar((unsigned char) msg[i])) {
+            n += escapeControlChar((unsigned char) msg[i], &escaped[n]);
+        } else {
+            escaped[n++] = msg[i];
+        }
+    }
+    *msglen = escapedlen;
+    return escaped;
+}
+
+/* Stamp the record and render the fields before the message into the buffer
+   and the ones after it into the record. Return the prefix length. */
+static size_t beginRecord(LogRecord* rec, LogLevel level, const char* file, int line,
+        char* buf, size_t size)
+{
+    const Pattern* pattern = loadAcquire(&s_pattern);
+    const ClockState* clock;
+    unsigned long long ticks;
+    size_t prefixlen;
+    PROFILE_DECLARE(t)
+
+    clock = readClock(&ticks);
+    toLogTime(clock, ticks, &rec->time);
+    rec->currentTime = (unsigned long long) rec->time.sec * 1000 + rec->time.nsec / 1000000;
+    PROFILE(kStageClock, t);
+    rec->level = level;
+    rec->file = file;
+    rec->line = line;
+    rec->threadID = getCurrentThreadID();
+    PROFILE(kStageThread, t);
+    rec->context = s_context.text;
+    rec->contextlen = s_context.len;
+    rec->suffixlen = renderPattern(pattern, pattern->messageOp + 1, pattern->nops, rec,
+            rec->suffix, sizeof(rec->suffix));
+    prefixlen = renderPattern(pattern, 0, pattern->messageOp, rec, buf,
+            (size < kMaxPrefixLen) ? size : kMaxPrefixLen);
+    PROFILE(kStagePrefix, t);
+    return prefixlen;
+}
+
+/* Write a line to every logger */
+static void writeLine(Logger* lg, const LogRecord* rec)
+{
+    int loggers = loadRelaxed(&lg->loggers);
+    int perThread = hasFlag(loggers, kFileLogger)
+            && hasFlag(loadRelaxed(&lg->flog.options), LogFileOption_PER_THREAD);
+    int contended, sync = 0; /* false */
+    long size;
+    PROFILE_DECLARE(t)
+
+    if (perThread) {
+        writeThreadFile(lg, rec);
+        if ((loggers & ~kFileLogger) == 0) {
+            return;
+        }
+    }
+    /* a busy lock means a backlog of lines to batch */
+    PROFILE_RESTART(t);
+    contended = !tryLock(lg);
+    if (contended) {
+        lock(lg);
+    }
+    PROFILE(kStageLock, t);
+    if (hasFlag(lg->loggers, kConsoleLogger)) {
+        vclog(lg, rec);
+    }
+    if (hasFlag(lg->loggers, kFileLogger) && !perThread) {
+        PROFILE_RESTART(t);
+        if (rotateLogFiles(lg)) {
+            PROFILE(kStageRotate, t);
+            if (lg->flog.indexInterval > 0 && lg->flog.currentFileSize >= lg->flog.indexedSize) {
+                indexRecord(lg, rec);
+            }
+            size = vflog(lg->flog.output, &lg->flog.dedup, rec, &lg->flog.flushedTime);
+            addFileSize(lg, size);
+            PROFILE(kStageWrite, t);
+            if ((int) rec->level >= loadRelaxed(&s_flushLevel)) {
+                /* the batch goes out with the line, ahead of its delay */
+                fflush(lg->flog.output);
+                lg->flog.batched = 0;
+                sync = loadRelaxed(&s_syncFlush);
+            } else if (isAdaptive(lg)) {
+                batchFile(lg, rec, size, contended);
+            }
+            PROFILE(kStageFlush, t);
+            if (hasFlag(lg->flog.options, LogFileOption_SYNC_GROUP)
+                    || (hasFlag(lg->flog.options, LogFileOption_SYNC_PERIODIC)
+                    && rec->currentTime - lg->flog.syncedTime >= kSyncInterval)) {
+                lg->flog.syncedTime = rec->currentTime;
+                sync = 1; /* true */
+            }
+        }
+    }
+    if (hasFlag(lg->loggers, kSocketLogger)) {
+        vslog(lg, rec);
+    }
+    /* last, as the lock is released while the file is synced */
+    if (sync) {
+        PROFILE_RESTART(t);
+        syncLogFile(lg);
+        PROFILE(kStageSync, t);
+    }
+    unlock(lg);
+}
+
+static void copyToRing(size_t pos, const void* src, size_t len)
+{
+    size_t first = s_keptLines.size - pos;
+
+    if (len <= first) {
+        memcpy(&s_keptLines.data[pos], src, len);
+    } else {
+        memcpy(&s_keptLines.data[pos], src, first);
+        memcpy(s_keptLines.data, (const char*) src + first, len - first);
+    }
+}
+
+static void copyFromRing(size_t pos, void* dst, size_t len)
+{
+    size_t first = s_keptLines.size - pos;
+
+    if (len <= first) {
+        memcpy(dst, &s_keptLines.data[pos], len);
+    } else {
+        memcpy(dst, &s_keptLines.data[pos], first);
+        memcpy((char*) dst + first, s_keptLines.data, len - first);
+    }
+}
+
+/* Keep a line on this thread, dropping the oldest lines it does not fit with */
+static void keepLine(const LogRecord* rec)
+{
+    size_t size = loadRelaxed(&s_keepSize);
+    KeptLine kl;
+
+    if (s_keptLines.size != size) { /* resized by logger_keepContext() */
+        free(s_keptLines.data);
+        s_keptLines.data = (size > 0) ? (char*) malloc(size) : NULL;
+        s_keptLines.size = (s_keptLines.data != NULL) ? size : 0;
+        s_keptLines.start = 0;
+        s_keptLines.used = 0;
+#if !defined(_WIN32) && !defined(_WIN64)
+        pthread_setspecific(s_keptLinesKey, s_keptLines.data);
+#endif /* !defined(_WIN32) && !defined(_WIN64) */
+    }
+    if (sizeof(kl) + rec->len > s_keptLines.size) {
+        return;
+    }
+    while (s_keptLines.used + sizeof(kl) + rec->len > s_keptLines.size) {
+        copyFromRing(s_keptLines.start, &kl, sizeof(kl));
+        s_keptLines.start = (s_keptLines.start + sizeof(kl) + kl.len) % s_keptLines.size;
+        s_keptLines.used -= sizeof(kl) + kl.len;
+    }
+    kl.level = rec->level;
+    kl.file = rec->file;
+    kl.line = rec->line;
+    kl.hash = rec->hash;
+    kl.time = rec->time;
+    kl.len = rec->len;
+    copyToRing((s_keptLines.start + s_keptLines.used) % s_keptLines.size, &kl, sizeof(kl));
+    copyToRing((s_keptLines.start + s_keptLines.used + sizeof(kl)) % s_keptLines.size,
+            rec->text, rec->len);
+    s_keptLines.used += sizeof(kl) + rec->len;
+}
+
+/* Write the lines kept on this thread in order and forget them */
+static void dumpKeptLines(Logger* lg)
+{
+    LogRecord rec;
+    KeptLine kl;
+    char* text;
+    size_t pos;
+
+    memset(&rec, 0, sizeof(rec));
+    rec.threadID = getCurrentThreadID();
+    rec.context = "";
+    rec.currentTime = getCurrentMillis();
+    while (s_keptLines.used > 0) {
+        copyFromRing(s_keptLines.start, &kl, sizeof(kl));
+        pos = (s_keptLines.start + sizeof(kl)) % s_keptLines.size;
+        s_keptLines.start = (pos + kl.len) % s_keptLines.size;
+        s_keptLines.used -= sizeof(kl) + kl.len;
+        /* a line wrapping around the end of the ring is copied out of it */
+        if (pos + kl.len <= s_keptLines.size) {
+            text = &s_keptLines.data[pos];
+        } else if ((text = (char*) malloc(kl.len)) != NULL) {
+            copyFromRing(pos, text, kl.len);
+        } else {
+            continue;
+        }
+        rec.level = kl.level;
+        rec.file = kl.file;
+        rec.line = kl.line;
+        rec.hash = kl.hash;
+        rec.time = kl.time;
+        rec.text = text;
+        rec.len = kl.len;
+        writeLine(lg, &rec);
+        if (text != &s_keptLines.data[pos]) {
+            free(text);
+        }
+    }
+    s_keptLines.start = 0;
+}
+
+/* Terminate the line following the message and write it to every logger, or keep it
+   on the thread if only logger_keepContext() lets it through */
+static void writeRecord(Logger* lg, LogRecord* rec, char* text, size_t prefixlen, size_t msglen)
+{
+    char* rendered = text;
+
+    if (loadRelaxed(&s_sanitize)) {
+        text = escapeMessage(text, prefixlen, &msglen, rec->suffixlen);
+    }
+    memcpy(&text[prefixlen + msglen], rec->suffix, rec->suffixlen);
+    text[prefixlen + msglen + rec->suffixlen] = '\n';
+    rec->text = text;
+    rec->len = prefixlen + msglen + rec->suffixlen + 1;
+    rec->hash = (loadRelaxed(&lg->clog.dedup.enabled) || loadRelaxed(&lg->flog.dedup.enabled)
+            || loadRelaxed(&lg->slog.dedup.enabled))
+            ? hashRecord(rec->level, rec->file, rec->line, &text[prefixlen], msglen) : 0;
+
+    if (rec->kept) {
+        keepLine(rec);
+    } else {
+        if ((int) rec->level >= LogLevel_ERROR && lg == &s_default && s_keptLines.used > 0) {
+            dumpKeptLines(lg);
+        }
+        writeLine(lg, rec);
+    }
+    if (text != rendered) {
+        freeLine(kEscapedLine, text);
+    }
+}
+
+void logger_dumpContext(void)
+{
+    if (loadRelaxed(&s_default.loggers) == 0 || !s_initialized) {
+        assert(0 && "logger is not initialized");
+        return;
+    }
+    dumpKeptLines(&s_default);
+}
+
+/* Format the message of a line with arg, and with again if it is too long for the stack */
+static void vlog(Logger* lg, LogLevel level, const char* file, int line, int forced,
+        const char* fmt, va_list arg, va_list again)
+{
+    LogRecord rec;
+    char buf[kLineBufferSize];
+    char* text = buf;
+    size_t prefixlen;
+    int size, kept = !forced && !isEnabled(lg, level);
+    PROFILE_DECLARE(start)
+    PROFILE_DECLARE(t)
+
+    if (kept && !isKept(lg, level)) {
+        return;
+    }
+    /* render the line once for all loggers */
+    prefixlen = beginRecord(&rec, level, file, line, buf, sizeof(buf));
+    rec.kept = kept;
+    PROFILE_RESTART(t);
+    size = vsnprintf(&buf[prefixlen], sizeof(buf) - prefixlen - rec.suffixlen, fmt, arg);
+    if (size < 0) {
+        size = 0;
+    } else if (prefixlen + size + rec.suffixlen + 1 > sizeof(buf)) {
+        if ((text = allocLine(kLongLine, prefixlen + size + rec.suffixlen + 2)) != NULL) {
+            memcpy(text, buf, prefixlen);
+            vsnprintf(&text[prefixlen], size + 1, fmt, again);
+        } else {
+            text = buf;
+            size = sizeof(buf) - prefixlen - rec.suffixlen - 1;
+        }
+    }
+    PROFILE(kStageMessage, t);
+    writeRecord(lg, &rec, text, prefixlen, size);
+    if (text != buf) {
+        freeLine(kLongLine, text);
+    }
+    PROFILE(kStageTotal, start);
 }
 
 void logger_log(LogLevel level, const char* file, int line, const char* fmt, ...)
 {
-    struct timeval now;
-    unsigned long long currentTime; /* milliseconds */
-    char levelc;
-    char timestamp[32];
-    long threadID;
-    va_list carg, farg;
+    va_list arg, again;
+
+    if (loadRelaxed(&s_default.loggers) == 0 || !s_initialized) {
+        assert(0 && "logger is not initialized");
+        return;
+    }
+
+    va_start(arg, fmt);
+    va_start(again, fmt);
+    vlog(&s_default, level, file, line, 0, fmt, arg, again);
+    va_end(again);
+    va_end(arg);
+}
+
+void logger_logMessage(LogLevel level, const char* file, int line, const char* message, size_t len)
+{
+    Logger* lg = &s_default;
+    LogRecord rec;
+    char buf[kLineBufferSize];
+    char* text = buf;
+    size_t prefixlen;
+    int kept = !isEnabled(lg, level);
 
-    if (s_logger == 0 || !s_initialized) {
+    if (loadRelaxed(&lg->loggers) == 0 || !s_initialized) {
         assert(0 && "logger is not initialized");
         return;
     }
 
-    if (!logger_isEnabled(level)) {
+    if (kept && !isKept(lg, level)) {
         return;
     }
-    gettimeofday(&now, NULL);
-    currentTime = now.tv_sec * 1000 + now.tv_usec / 1000;
-    levelc = getLevelChar(level);
-    getTimestamp(&now, timestamp, sizeof(timestamp));
-    threadID = getCurrentThreadID();
-    lock();
-    if (hasFlag(s_logger, kConsoleLogger)) {
-        va_start(carg, fmt);
-        vflog(s_clog.output, levelc, timestamp, threadID,
-                file, line, fmt, carg, currentTime, &s_clog.flushedTime);
-        va_end(carg);
+    prefixlen = beginRecord(&rec, level, file, line, buf, sizeof(buf));
+    rec.kept = kept;
+    if (prefixlen + len + rec.suffixlen + 1 > sizeof(buf)) {
+        if ((text = allocLine(kLongLine, prefixlen + len + rec.suffixlen + 1)) != NULL) {
+            memcpy(text, buf, prefixlen);
+        } else {
+            text = buf;
+            len = sizeof(buf) - prefixlen - rec.suffixlen - 1;
+        }
+    }
+    memcpy(&text[prefixlen], message, len);
+    writeRecord(lg, &rec, text, prefixlen, len);
+    if (text != buf) {
+        freeLine(kLongLine, text);
     }
-    if (hasFlag(s_logger, kFileLogger)) {
-        if (rotateLogFiles()) {
-            va_start(farg, fmt);
-            s_flog.currentFileSize += vflog(s_flog.output, levelc, timestamp, threadID,
-                    file, line, fmt, farg, currentTime, &s_flog.flushedTime);
-            va_end(farg);
+}
+
+/* Render "0010  48 65 6c 6c 6f 2c 20 77  6f 72 6c 64 21 0a 00 00  |Hello, world!...|"
+   and return its length */
+static size_t formatHexRow(const unsigned char* data, size_t offset, size_t len, char* buf)
+{
+    size_t i, n = 0;
+
+    memcpy(&buf[n], &kHexPairs[((offset >> 8) & 0xff) * 2], 2);
+    memcpy(&buf[n + 2], &kHexPairs[(offset & 0xff) * 2], 2);
+    n += 4;
+    buf[n++] = ' ';
+    for (i = 0; i < kHexDumpRowSize; i++) {
+        if (i % 8 == 0) {
+            buf[n++] = ' ';
+        }
+        if (i < len) {
+            memcpy(&buf[n], &kHexPairs[data[i] * 2], 2);
+        } else {
+            buf[n] = buf[n + 1] = ' ';
         }
+        buf[n + 2] = ' ';
+        n += 3;
+    }
+    buf[n++] = ' ';
+    buf[n++] = '|';
+    for (i = 0; i < len; i++) {
+        buf[n++] = (data[i] >= 0x20 && data[i] < 0x7f) ? (char) data[i] : '.';
+    }
+    buf[n++] = '|';
+    return n;
+}
+
+void logger_logHex(LogLevel level, const char* file, int line, const void* data, size_t len)
+{
+    const unsigned char* bytes = (const unsigned char*) data;
+    Logger* lg = &s_default;
+    LogRecord rec;
+    char buf[kLineBufferSize];
+    size_t prefixlen, msglen, offset, dumped;
+    int kept = !isEnabled(lg, level);
+
+    if (loadRelaxed(&lg->loggers) == 0 || !s_initialized) {
+        assert(0 && "logger is not initialized");
+        return;
+    }
+    if (data == NULL && len > 0) {
+        assert(0 && "data must not be NULL");
+        return;
+    }
+
+    if (kept && !isKept(lg, level)) {
+        return;
+    }
+    /* the rows share the prefix rendered once */
+    prefixlen = beginRecord(&rec, level, file, line, buf, sizeof(buf));
+    rec.kept = kept;
+    dumped = (len < kMaxHexDumpSize) ? len : kMaxHexDumpSize;
+    for (offset = 0; offset < dumped; offset += kHexDumpRowSize) {
+        msglen = formatHexRow(&bytes[offset], offset,
+                (dumped - offset < kHexDumpRowSize) ? dumped - offset : kHexDumpRowSize,
+                &buf[prefixlen]);
+        writeRecord(lg, &rec, buf, prefixlen, msglen);
+    }
+    if (len == 0) {
+        msglen = sprintf(&buf[prefixlen], "(0 bytes)");
+        writeRecord(lg, &rec, buf, prefixlen, msglen);
+    } else if (dumped < len) {
+        msglen = sprintf(&buf[prefixlen], "(%lu bytes not dumped)", (unsigned long) (len - dumped));
+        writeRecord(lg, &rec, buf, prefixlen, msglen);
     }
-    unlock();
 }
 
 void logger_exitFileLogger()
 {
-    if (s_flog.output)
-        fclose(s_flog.output);
-}
\ No newline at end of file
+    if (!s_initialized) {
+        return;
+    }
+    exitFileLogger(&s_default);
+}
+
+static void exitFileLogger(Logger* lg)
+{
+    lock(lg);
+    stopFileFlusher(lg);
+    if (lg->flog.output != NULL) {
+        writeRepeatSummary(lg->flog.output, &lg->flog.dedup);
+        syncClosingFile(lg);
+        closeLogFile(lg, lg->flog.output);
+        lg->flog.output = NULL;
+    }
+    lg->flog.batched = 0;
+    closeIndexFile(lg);
+    closeSharedFile(lg);
+    flushThreadFiles(lg);
+    storeRelaxed(&lg->flog.threadGeneration, lg->flog.threadGeneration + 1);
+    storeRelaxed(&lg->loggers, lg->loggers & ~kFileLogger);
+    unlock(lg);
+}
+
+logger_t* logger_create(void)
+{
+    Logger* lg;
+
+    init();
+    if ((lg = (Logger*) calloc(1, sizeof(Logger))) == NULL) {
+        fprintf(stderr, "ERROR: logger: Failed to allocate a logger\n");
+        return NULL;
+    }
+    lg->level = LogLevel_INFO;
+    initLogger(lg);
+    lockInstances();
+    lg->next = s_instances;
+    s_instances = lg;
+    unlockInstances();
+    return lg;
+}
+
+void logger_destroy(logger_t* logger)
+{
+    Logger** p;
+
+    if (logger == NULL || logger == &s_default) {
+        assert(0 && "logger must be created by logger_create()");
+        return;
+    }
+
+    /* out of the handlers run at exit before it is torn down */
+    lockInstances();
+    for (p = &s_instances; *p != NULL; p = &(*p)->next) {
+        if (*p == logger) {
+            *p = logger->next;
+            break;
+        }
+    }
+    unlockInstances();
+    if (loadRelaxed(&logger->loggers) != 0) {
+        flushLogger(logger);
+    }
+    lock(logger);
+    stopConsoleWriter(logger);
+    unlock(logger);
+    exitFileLogger(logger);
+    exitSocketLogger(logger);
+#if defined(_WIN32) || defined(_WIN64)
+    DeleteCriticalSection(&logger->mutex);
+#else
+    free(logger->clog.buffers[0]);
+    pthread_mutex_destroy(&logger->mutex);
+    pthread_mutex_destroy(&logger->clog.mutex);
+    pthread_cond_destroy(&logger->clog.ready);
+    pthread_cond_destroy(&logger->clog.drained);
+    pthread_cond_destroy(&logger->flog.batchStarted);
+    pthread_cond_destroy(&logger->flog.fileSynced);
+    pthread_cond_destroy(&logger->retention.wakeup);
+#endif /* defined(_WIN32) || defined(_WIN64) */
+    free(logger);
+}
+
+int logger_addConsole(logger_t* logger, FILE* output, int options)
+{
+    if (logger == NULL) {
+        assert(0 && "logger must not be NULL");
+        return 0;
+    }
+    return initConsoleLogger(logger, output, options);
+}
+
+int logger_addFile(logger_t* logger, const char* filename, long maxFileSize,
+        unsigned char maxBackupFiles, int options)
+{
+    if (logger == NULL) {
+        assert(0 && "logger must not be NULL");
+        return 0;
+    }
+    if (logger != &s_default && hasFlag(options, LogFileOption_PER_THREAD)) {
+        assert(0 && "only the default logger writes files per thread");
+        return 0;
+    }
+    return initFileLogger(logger, filename, maxFileSize, maxBackupFiles, options);
+}
+
+int logger_addSocket(logger_t* logger, const char* path, LogSocketType type)
+{
+    if (logger == NULL) {
+        assert(0 && "logger must not be NULL");
+        return 0;
+    }
+    return initSocketLogger(logger, path, type);
+}
+
+void logger_setLoggerLevel(logger_t* logger, LogLevel level)
+{
+    if (logger == NULL) {
+        assert(0 && "logger must not be NULL");
+        return;
+    }
+    lock(logger);
+    storeRelaxed(&logger->level, level);
+    unlock(logger);
+}
+
+LogLevel logger_getLoggerLevel(logger_t* logger)
+{
+    if (logger == NULL) {
+        assert(0 && "logger must not be NULL");
+        return LogLevel_INFO;
+    }
+    return loadRelaxed(&logger->level);
+}
+
+int logger_isLoggerEnabled(logger_t* logger, LogLevel level)
+{
+    if (logger == NULL) {
+        assert(0 && "logger must not be NULL");
+        return 0;
+    }
+    return isEnabled(logger, level);
+}
+
+void logger_logTo(logger_t* logger, LogLevel level, const char* file, int line, const char* fmt, ...)
+{
+    va_list arg, again;
+
+    if (logger == NULL || loadRelaxed(&logger->loggers) == 0) {
+        assert(0 && "logger is not initialized");
+        return;
+    }
+
+    va_start(arg, fmt);
+    va_start(again, fmt);
+    vlog(logger, level, file, line, 0, fmt, arg, again);
+    va_end(again);
+    va_end(arg);
+}
+
+void logger_flushLogger(logger_t* logger)
+{
+    if (logger == NULL || loadRelaxed(&logger->loggers) == 0) {
+        assert(0 && "logger is not initialized");
+        return;
+    }
+    flushLogger(logger);
+}
+
+void logger_logSite(LogSite* site, const char* fmt, ...)
+{
+    const char* file = site->file;
+    const char* name;
+    va_list arg, again;
+
+    if (loadRelaxed(&s_default.loggers) == 0 || !s_initialized) {
+        assert(0 && "logger is not initialized");
+        return;
+    }
+
+    /* the file name of __FILENAME__ */
+#if defined(_WIN32) || defined(_WIN64)
+    if ((name = strrchr(file, '\\')) != NULL) {
+#else
+    if ((name = strrchr(file, '/')) != NULL) {
+#endif /* defined(_WIN32) || defined(_WIN64) */
+        file = name + 1;
+    }
+    va_start(arg, fmt);
+    va_start(again, fmt);
+    vlog(&s_default, site->level, file, site->line, loadRelaxed(&site->mode) == LogSite_ON,
+            fmt, arg, again);
+    va_end(again);
+    va_end(arg);
+}
+
+size_t logger_getSites(LogSite** sites)
+{
+    if (sites == NULL) {
+        assert(0 && "sites must not be NULL");
+        return 0;
+    }
+#if defined(LOGGER_HAVE_SITES)
+    *sites = __start_logger_sites;
+    return (size_t) (__stop_logger_sites - __start_logger_sites);
+#else
+    *sites = NULL;
+    return 0;
+#endif /* defined(LOGGER_HAVE_SITES) */
+}
+
+void logger_setSite(LogSite* site, LogSiteMode mode)
+{
+    if (site == NULL) {
+        assert(0 && "site must not be NULL");
+        return;
+    }
+    init();
+    lock(&s_default);
+    storeRelaxed(&site->mode, mode);
+    updateSite(site);
+    unlock(&s_default);
+}
+
+int logger_setSites(const char* pattern, LogSiteMode mode)
+{
+#if defined(LOGGER_HAVE_SITES)
+    char glob[kMaxFileNameLen + 1];
+    const char* colon;
+    const char* name;
+    LogSite* site;
+    size_t len;
+    int line = 0, count = 0;
+
+    if (pattern == NULL) {
+        assert(0 && "pattern must not be NULL");
+        return 0;
+    }
+    /* <glob>[:<line>] */
+    if ((colon = strrchr(pattern, ':')) != NULL && colon[1] != '\0'
+            && strspn(&colon[1], "0123456789") == strlen(&colon[1])) {
+        line = atoi(&colon[1]);
+        len = colon - pattern;
+    } else {
+        len = strlen(pattern);
+    }
+    if (len > kMaxFileNameLen) {
+        assert(0 && "pattern exceeds the maximum number of characters");
+        return 0;
+    }
+    memcpy(glob, pattern, len);
+    glob[len] = '\0';
+
+    init();
+    lock(&s_default);
+    for (site = __start_logger_sites; site < __stop_logger_sites; site++) {
+        name = site->file;
+        if (strchr(glob, '/') == NULL && strrchr(name, '/') != NULL) {
+            name = strrchr(name, '/') + 1;
+        }
+        if ((line == 0 || site->line == line) && fnmatch(glob, name, 0) == 0) {
+            storeRelaxed(&site->mode, mode);
+            updateSite(site);
+            count++;
+        }
+    }
+    unlock(&s_default);
+    return count;
+#else
+    fprintf(stderr, "ERROR: logger: Call sites are not supported on this platform\n");
+    return 0;
+#endif /* defined(LOGGER_HAVE_SITES) */
+}
@@ -14,12 +14,76 @@ extern "C" {
  #define __FILENAME__ (strrchr(__FILE__, '/') ? strrchr(__FILE__, '/') + 1 : __FILE__)
 #endif /* defined(_WIN32) || defined(_WIN64) */
 
-#define LOG_TRACE(fmt, ...) logger_log(LogLevel_TRACE, __FILENAME__, __LINE__, fmt, ##__VA_ARGS__)
-#define LOG_DEBUG(fmt, ...) logger_log(LogLevel_DEBUG, __FILENAME__, __LINE__, fmt, ##__VA_ARGS__)
-#define LOG_INFO(fmt, ...)  logger_log(LogLevel_INFO , __FILENAME__, __LINE__, fmt, ##__VA_ARGS__)
-#define LOG_WARN(fmt, ...)  logger_log(LogLevel_WARN , __FILENAME__, __LINE__, fmt, ##__VA_ARGS__)
-#define LOG_ERROR(fmt, ...) logger_log(LogLevel_ERROR, __FILENAME__, __LINE__, fmt, ##__VA_ARGS__)
-#define LOG_FATAL(fmt, ...) logger_log(LogLevel_FATAL, __FILENAME__, __LINE__, fmt, ##__VA_ARGS__)
+#if defined(__GNUC__)
+ #define LOGGER_UNLIKELY(x) __builtin_expect(!!(x), 0)
+ #define LOGGER_ENABLED_LEVEL() __atomic_load_n(&logger_enabledLevel, __ATOMIC_RELAXED)
+#else
+ #define LOGGER_UNLIKELY(x) (x)
+ #define LOGGER_ENABLED_LEVEL() logger_enabledLevel
+#endif /* defined(__GNUC__) */
+
+/* The level is checked inline so that the arguments of a disabled message are never evaluated */
+#define LOGGER_LOG(level, fmt, ...) do { \
+    if (LOGGER_UNLIKELY(LOGGER_ENABLED_LEVEL() <= (level))) { \
+        logger_log(level, __FILENAME__, __LINE__, fmt, ##__VA_ARGS__); \
+    } \
+} while (0)
+
+/* C++ is left out: the sites of inline functions would conflict with the others in the section */
+#if defined(__GNUC__) && defined(__ELF__) && !defined(__cplusplus)
+ #define LOGGER_HAVE_SITES 1
+ #define LOGGER_SITE_FLAG(site) __atomic_load_n(&(site)->enabled, __ATOMIC_RELAXED)
+
+/*
+ * Every call site is described in the logger_sites section, see logger_getSites().
+ * Once the registry has resolved the flag of the site, checking it is a single load.
+ */
+#define LOGGER_SITE_LOG(level, fmt, ...) do { \
+    static LogSite logger_site \
+            __attribute__((section("logger_sites"), used, aligned(__alignof__(LogSite)))) = \
+            { level, __FILE__, __LINE__, #fmt }; \
+    int logger_flag = LOGGER_SITE_FLAG(&logger_site); \
+    if (LOGGER_UNLIKELY(logger_flag == LOGGER_SITE_ON \
+            || (logger_flag == LOGGER_SITE_UNRESOLVED && LOGGER_ENABLED_LEVEL() <= (level)))) { \
+        logger_logSite(&logger_site, fmt, ##__VA_ARGS__); \
+    } \
+} while (0)
+
+ #define LOG_TRACE(fmt, ...) LOGGER_SITE_LOG(LogLevel_TRACE, fmt, ##__VA_ARGS__)
+ #define LOG_DEBUG(fmt, ...) LOGGER_SITE_LOG(LogLevel_DEBUG, fmt, ##__VA_ARGS__)
+ #define LOG_INFO(fmt, ...)  LOGGER_SITE_LOG(LogLevel_INFO , fmt, ##__VA_ARGS__)
+ #define LOG_WARN(fmt, ...)  LOGGER_SITE_LOG(LogLevel_WARN , fmt, ##__VA_ARGS__)
+ #define LOG_ERROR(fmt, ...) LOGGER_SITE_LOG(LogLevel_ERROR, fmt, ##__VA_ARGS__)
+ #define LOG_FATAL(fmt, ...) LOGGER_SITE_LOG(LogLevel_FATAL, fmt, ##__VA_ARGS__)
+#else
+ #define LOG_TRACE(fmt, ...) LOGGER_LOG(LogLevel_TRACE, fmt, ##__VA_ARGS__)
+ #define LOG_DEBUG(fmt, ...) LOGGER_LOG(LogLevel_DEBUG, fmt, ##__VA_ARGS__)
+ #define LOG_INFO(fmt, ...)  LOGGER_LOG(LogLevel_INFO , fmt, ##__VA_ARGS__)
+ #define LOG_WARN(fmt, ...)  LOGGER_LOG(LogLevel_WARN , fmt, ##__VA_ARGS__)
+ #define LOG_ERROR(fmt, ...) LOGGER_LOG(LogLevel_ERROR, fmt, ##__VA_ARGS__)
+ #define LOG_FATAL(fmt, ...) LOGGER_LOG(LogLevel_FATAL, fmt, ##__VA_ARGS__)
+#endif /* defined(__GNUC__) && defined(__ELF__) && !defined(__cplusplus) */
+
+/* Log a hex dump of a buffer if the level is enabled */
+#define LOG_HEX(level, data, len) do { \
+    if (LOGGER_UNLIKELY(LOGGER_ENABLED_LEVEL() <= (level))) { \
+        logger_logHex(level, __FILENAME__, __LINE__, data, len); \
+    } \
+} while (0)
+
+/* Log to a logger created by logger_create() if its level is enabled */
+#define LOGGER_LOG_TO(logger, level, fmt, ...) do { \
+    if (logger_isLoggerEnabled(logger, level)) { \
+        logger_logTo(logger, level, __FILENAME__, __LINE__, fmt, ##__VA_ARGS__); \
+    } \
+} while (0)
+
+#define LOG_TRACE_TO(logger, fmt, ...) LOGGER_LOG_TO(logger, LogLevel_TRACE, fmt, ##__VA_ARGS__)
+#define LOG_DEBUG_TO(logger, fmt, ...) LOGGER_LOG_TO(logger, LogLevel_DEBUG, fmt, ##__VA_ARGS__)
+#define LOG_INFO_TO(logger, fmt, ...)  LOGGER_LOG_TO(logger, LogLevel_INFO , fmt, ##__VA_ARGS__)
+#define LOG_WARN_TO(logger, fmt, ...)  LOGGER_LOG_TO(logger, LogLevel_WARN , fmt, ##__VA_ARGS__)
+#define LOG_ERROR_TO(logger, fmt, ...) LOGGER_LOG_TO(logger, LogLevel_ERROR, fmt, ##__VA_ARGS__)
+#define LOG_FATAL_TO(logger, fmt, ...) LOGGER_LOG_TO(logger, LogLevel_FATAL, fmt, ##__VA_ARGS__)
 
 typedef enum {
     LogLevel_TRACE,
@@ -30,6 +94,71 @@ typedef enum {
     LogLevel_FATAL,
 } LogLevel;
 
+/* Whether a call site logs */
+typedef enum {
+    LogSite_DEFAULT, /* at the log level */
+    LogSite_ON, /* at any level */
+    LogSite_OFF,
+} LogSiteMode;
+
+/* The flag of a call site */
+enum {
+    LOGGER_SITE_UNRESOLVED, /* the site follows logger_enabledLevel */
+    LOGGER_SITE_OFF,
+    LOGGER_SITE_ON,
+};
+
+/* A LOG_* call site */
+typedef struct {
+    LogLevel level;
+    const char* file; /* __FILE__ */
+    int line;
+    const char* format; /* as written in the source */
+    volatile int enabled; /* LOGGER_SITE_*, read by the LOG_* macros */
+    LogSiteMode mode;
+} LogSite;
+
+/* A logger with its own loggers, level and lock, see logger_create() */
+typedef struct Logger logger_t;
+
+/*
+ * The lowest level that may be logged, read by the LOG_* macros.
+ * Do not modify; use logger_setLevel() instead.
+ */
+extern volatile LogLevel logger_enabledLevel;
+
+typedef enum {
+    LogSink_CONSOLE = 1 << 0,
+    LogSink_FILE = 1 << 1,
+    LogSink_SOCKET = 1 << 2,
+} LogSink;
+
+typedef enum {
+    LogFileOption_SHARED = 1 << 0,
+    LogFileOption_PREALLOCATE = 1 << 1,
+    LogFileOption_DIRECT = 1 << 2,
+    LogFileOption_PER_THREAD = 1 << 3,
+    LogFileOption_ADAPTIVE = 1 << 4,
+    LogFileOption_SYNC_PERIODIC = 1 << 5,
+    LogFileOption_SYNC_GROUP = 1 << 6,
+} LogFileOption;
+
+typedef enum {
+    LogConsoleOption_ASYNC = 1 << 0,
+    LogConsoleOption_COLOR = 1 << 1,
+} LogConsoleOption;
+
+typedef enum {
+    LogSocket_DGRAM,
+    LogSocket_STREAM,
+} LogSocketType;
+
+typedef enum {
+    LogClock_REALTIME,
+    LogClock_MONOTONIC,
+    LogClock_TSC,
+} LogClock;
+
 /**
  * Initialize the logger as a console logger.
  * If the file pointer is NULL, stdout will be used.
@@ -39,6 +168,25 @@ typedef enum {
  */
 int logger_initConsoleLogger(FILE* output);
 
+/**
+ * Initialize the logger as a console logger with options.
+ * If the file pointer is NULL, stdout will be used.
+ *
+ * The following options are available.
+ * - LogConsoleOption_ASYNC: Write the console on a thread of its own from a bounded
+ *   buffer, so that a slow terminal or pipe reader never blocks the logging threads
+ *   or the other loggers. Lines are written as they come to a terminal and in large
+ *   batches at least every 100 ms to a pipe or file. Lines are dropped while the
+ *   buffer is full and counted in LogStats. logger_flush() waits for the writer.
+ *   Not on Windows.
+ * - LogConsoleOption_COLOR: Color the lines by level if the output is a terminal.
+ *
+ * @param[in] output A file pointer. Make sure to set stdout or stderr.
+ * @param[in] options A bitwise OR of LogConsoleOption values
+ * @return Non-zero value upon success or 0 on error
+ */
+int logger_initConsoleLoggerEx(FILE* output, int options);
+
 /**
  * @brief 
  * 
@@ -59,6 +207,68 @@ void logger_exitFileLogger();
  */
 int logger_initFileLogger(const char* filename, long maxFileSize, unsigned char maxBackupFiles);
 
+/**
+ * Initialize the logger as a file logger with options.
+ * If the filename is NULL, return without doing anything.
+ *
+ * The following options are available.
+ * - LogFileOption_SHARED: Share the file with other processes logging to it with this option.
+ *   Each line is appended with one write(2), and the file size and rotation are
+ *   coordinated through `<filename>.lock` so that only one process rotates the files.
+ *   Lines longer than 64 KB may interleave.
+ * - LogFileOption_PREALLOCATE: Reserve maxFileSize bytes for each file when it is opened
+ *   so that the file is not extended block by block. The reserved blocks past the end
+ *   of the file are released when it is closed. Linux only.
+ * - LogFileOption_DIRECT: Write the file with O_DIRECT in blocks of 256 KB, bypassing
+ *   the page cache. The last partial block is written padded with zeros at every flush
+ *   and the padding is cut off when the file is closed. Falls back to buffered output
+ *   if the file system does not support O_DIRECT. Linux only, not with LogFileOption_SHARED.
+ * - LogFileOption_PER_THREAD: Write each thread to its own file `<filename>.t<thread ID>`,
+ *   rotated and buffered separately, without taking the logger lock except to open or
+ *   rotate the file. Merge the files into one stream with tools/logmerge. A file is
+ *   closed when its thread exits. Not with LogFileOption_SHARED, not on Windows.
+ * - LogFileOption_ADAPTIVE: Batch the writes by load instead of by the stdio buffer size.
+ *   Lines are written at once while the traffic is light. While lines arrive in bursts
+ *   or threads wait for the logger lock, batches grow up to 256 KB, and no line waits
+ *   more than 10 ms (on Windows, until the next line or flush). The current batch size
+ *   is reported in LogStats. Ignored with LogFileOption_SHARED and LogFileOption_PER_THREAD.
+ * - LogFileOption_SYNC_PERIODIC: Sync the file to the disk (fdatasync) at the first line
+ *   after each second, at every logger_flush() and before the file is closed, so that a
+ *   power loss takes at most about a second of lines.
+ * - LogFileOption_SYNC_GROUP: Return from each logging call once its line is synced to
+ *   the disk. One thread syncs at a time, outside the logger lock, and the lines written
+ *   by other threads meanwhile are synced together by the next one, so that concurrent
+ *   callers share one fdatasync instead of paying one each.
+ *
+ * @param[in] filename The name of the output file
+ * @param[in] maxFileSize The maximum number of bytes to write to any one file
+ * @param[in] maxBackupFiles The maximum number of files for backup
+ * @param[in] options A bitwise OR of LogFileOption values
+ * @return Non-zero value upon success or 0 on error
+ */
+int logger_initFileLoggerEx(const char* filename, long maxFileSize, unsigned char maxBackupFiles,
+        int options);
+
+/**
+ * Initialize the logger as a socket logger sending to a local collector.
+ * Lines are batched and sent over a Unix domain socket without blocking
+ * the logging threads. Datagrams only ever contain whole lines.
+ * If the collector is unreachable, lines are kept in a bounded buffer and
+ * the connection is retried; lines that do not fit are dropped and counted.
+ * Batches are sent when they are full, at the auto flush interval,
+ * on logger_flush() and at exit.
+ *
+ * @param[in] path The path of the collector socket
+ * @param[in] type The socket type
+ * @return Non-zero value upon success or 0 on error
+ */
+int logger_initSocketLogger(const char* path, LogSocketType type);
+
+/**
+ * Send the remaining lines and close the socket logger.
+ */
+void logger_exitSocketLogger(void);
+
 /**
  * Set the log level.
  * Message levels lower than this value will be discarded.
@@ -76,13 +286,187 @@ void logger_setLevel(LogLevel level);
  */
 LogLevel logger_getLevel(void);
 
+/**
+ * Set the log level of the calling thread, overriding logger_setLevel() for it,
+ * e.g. to trace one request without tracing every other thread.
+ * The other threads are still checked against logger_setLevel(), though the LOG_*
+ * macros let messages down to the lowest level of any thread through to that check.
+ * The override is cleared when the thread exits.
+ *
+ * @param[in] level A log level
+ */
+void logger_setThreadLevel(LogLevel level);
+
+/**
+ * Clear the log level of the calling thread so that it follows logger_setLevel() again.
+ */
+void logger_clearThreadLevel(void);
+
+/**
+ * Get the log level of the calling thread set by logger_setThreadLevel().
+ *
+ * @param[out] level The log level of the thread, if any
+ * @return Non-zero value if the thread has its own level or 0 otherwise
+ */
+int logger_getThreadLevel(LogLevel* level);
+
+/**
+ * Push a key and value onto the context of the calling thread, e.g. a request ID.
+ * The context is kept rendered as "key=value key=value" and shown before the
+ * message in the default format, or wherever a format has `%X`.
+ * Every push must be paired with logger_popContext(), even if it failed.
+ *
+ * @param[in] key The key
+ * @param[in] value The value
+ * @return Non-zero value upon success or 0 if the context is full
+ */
+int logger_pushContext(const char* key, const char* value);
+
+/**
+ * Pop the last key and value pushed onto the context of the calling thread.
+ */
+void logger_popContext(void);
+
 /**
  * Check if a message of the level would actually be logged.
+ * The level of the calling thread is checked first, then the level of the logger.
  *
  * @return Non-zero value if the log level is enabled
  */
 int logger_isEnabled(LogLevel level);
 
+/**
+ * Set the clock used to timestamp log messages.
+ * LogClock_REALTIME reads the wall clock on every call (default).
+ * LogClock_MONOTONIC and LogClock_TSC only capture a raw counter
+ * (CLOCK_MONOTONIC_COARSE or the CPU time stamp counter) when logging,
+ * and convert it to wall-clock time with a calibration taken by this function.
+ * Wall-clock adjustments made after the calibration are not followed.
+ * The clock may be changed while other threads log.
+ *
+ * @param[in] clock A clock type
+ * @return Non-zero value upon success or 0 on error
+ */
+int logger_setClock(LogClock clock);
+
+/**
+ * Get the clock that has been set.
+ * The default clock is LogClock_REALTIME.
+ *
+ * @return The clock type
+ */
+LogClock logger_getClock(void);
+
+/**
+ * Set the format of log lines. The format is compiled once here, so that
+ * logging only copies its literals and renders its fields.
+ * The following fields are available, and `%m` must appear exactly once.
+ * - %L: The level as one character (T, D, I, W, E or F)
+ * - %V: The level name (TRACE, DEBUG, INFO, WARN, ERROR or FATAL)
+ * - %D: The local time as yy-MM-dd hh:mm:ss.uuuuuu
+ * - %D{iso8601}: The local time as yyyy-MM-ddThh:mm:ss.uuuuuu+hh:mm
+ * - %D{utc}: The UTC time as yyyy-MM-ddThh:mm:ss.uuuuuuZ
+ * - %t: The thread ID
+ * - %f: The source filename
+ * - %l: The source line number
+ * - %X: The context of the thread as key=value pairs (see logger_pushContext())
+ * - %m: The message
+ * - %%: A percent sign
+ * The default is "%L %D %t %f:%l: %m", which tools/logmerge and tools/logquery read.
+ * Formats starting with "%L %D %t %f:%l: " and without %X render the context
+ * after it, if any.
+ * The format may be changed while other threads log.
+ *
+ * @param[in] format A format
+ * @return Non-zero value upon success or 0 on error
+ */
+int logger_setFormat(const char* format);
+
+/**
+ * Collapse consecutive duplicate messages.
+ * A message is a duplicate if its level, call site and rendered text are the same
+ * as the previous message on that logger. Repeats are suppressed and reported as
+ * one "last message repeated N times" line with the first and last timestamps,
+ * written when a different message arrives, on flush or at the auto flush interval.
+ * Deduplication is off in default.
+ *
+ * @param[in] sinks A bitwise OR of LogSink values to deduplicate. Switch off if 0.
+ */
+void logger_deduplicate(int sinks);
+
+/**
+ * Write a sparse time index of the file logger to `<filename>.idx`.
+ * Every interval bytes, the index maps the time of the next line to its offset
+ * in the file, so that tools/logquery can find the lines of a time range without
+ * reading the whole file. The index is rotated with its file.
+ * The index is a header "LOGIDX01" followed by pairs of unsigned 64-bit integers
+ * in the byte order of the host: microseconds since the epoch and a byte offset.
+ * Shared and per-thread files are not indexed.
+ * The index is off in default.
+ *
+ * @param[in] interval Bytes between index entries. Switch off if 0 or a negative integer.
+ */
+void logger_indexFile(long interval);
+
+/**
+ * Keep the backups of the file logger within a total size and an age, in addition
+ * to maxBackupFiles. The oldest backups are removed first: those past the total
+ * size of the newer ones, and those whose last line is older than the age.
+ * The backups are checked on a thread of their own after every rotation and every
+ * minute. It takes the logger lock only to remove the files, and the removed
+ * files are released from the disk outside the lock. Per-thread files are not
+ * retained, and not on Windows.
+ * Retention is off in default.
+ *
+ * @param[in] maxTotalSize The maximum number of bytes of all backups. No limit if 0.
+ * @param[in] maxAge The maximum age of a backup in seconds. No limit if 0 or a negative integer.
+ * @return Non-zero value upon success or 0 on error
+ */
+int logger_retainFiles(unsigned long long maxTotalSize, long maxAge);
+
+/**
+ * Escape the control characters of messages, so that untrusted strings logged
+ * in them cannot forge lines or terminal sequences. LF, CR and TAB are written
+ * as `\n`, `\r` and `\t` and the other control characters as `\xHH`.
+ * Only the message is escaped, and bytes from 0x80 are kept as they are.
+ * Sanitization is off in default.
+ *
+ * @param[in] enabled Non-zero value to escape the messages
+ */
+void logger_sanitize(int enabled);
+
+/**
+ * Write the lines of the level and above through at once, together with the
+ * lines batched before them, so that the lines that explain a crash are not
+ * left in a buffer. With sync the files are also synced to the disk
+ * (fdatasync) before the logging call returns.
+ * The level is LogLevel_ERROR without sync in default.
+ *
+ * @param[in] level The lowest level to write through
+ * @param[in] sync Non-zero value to sync the files to the disk as well
+ */
+void logger_flushLevel(LogLevel level, int sync);
+
+/**
+ * Keep the lines from the level up to below the log level in memory on each
+ * thread instead of writing them. They are written in order before the next
+ * line of LogLevel_ERROR or above of the thread, or at logger_dumpContext(),
+ * so that a failure comes with its detail at the cost of logging the errors only.
+ * When the lines of a thread exceed the size, the oldest ones are dropped.
+ * The lines are kept only for the default logger, and not on Windows.
+ * Keeping is off in default.
+ *
+ * @param[in] level The lowest level to keep
+ * @param[in] size The bytes kept per thread. Switch off if 0.
+ * @return Non-zero value upon success or 0 on error
+ */
+int logger_keepContext(LogLevel level, size_t size);
+
+/**
+ * Write the lines kept on this thread by logger_keepContext() and forget them.
+ */
+void logger_dumpContext(void);
+
 /**
  * Flush automatically.
  * Auto flush is off in default.
@@ -96,11 +480,43 @@ void logger_autoFlush(long interval);
  */
 void logger_flush(void);
 
+/* Counters of the logger since the process started */
+typedef struct {
+    unsigned long long socketSentBytes;
+    unsigned long long socketDroppedLines;
+    unsigned long long socketReconnects;
+    unsigned long long consoleDroppedLines;
+    long fileBatchSize; /* bytes, with LogFileOption_ADAPTIVE */
+    unsigned long long fileSyncs; /* times the file has been synced to the disk */
+} LogStats;
+
+/**
+ * Get the counters of the logger.
+ *
+ * @param[out] stats The counters
+ */
+void logger_getStats(LogStats* stats);
+
+/**
+ * Write the time spent in each stage of logging, added up from the histograms of
+ * all threads: reading the clock, getting the thread ID, rendering the prefix,
+ * formatting the message, waiting for the lock, rotating, writing, flushing and
+ * syncing the file, and the whole call. The times are in TSC cycles on x86 and
+ * in nanoseconds elsewhere, bucketed by powers of two.
+ * The stages are timed only if the library is compiled with LOGGER_PROFILE
+ * (`-Dprofile=ON`), which costs a few clock reads per line.
+ *
+ * @param[in] output A file pointer to write the profile to
+ * @return Non-zero value upon success or 0 if the library is compiled without LOGGER_PROFILE
+ */
+int logger_dumpProfile(FILE* output);
+
 /**
  * Log a message.
  * Make sure to call one of the following initialize functions before starting logging.
  * - logger_initConsoleLogger()
  * - logger_initFileLogger()
+ * - logger_initSocketLogger()
  *
  * @param[in] level A log level
  * @param[in] file A file name string
@@ -110,6 +526,173 @@ void logger_flush(void);
  */
 void logger_log(LogLevel level, const char* file, int line, const char* fmt, ...);
 
+/**
+ * Log a message that has already been formatted.
+ * This is the entry point of the type-safe C++ front end in logger.hpp.
+ *
+ * @param[in] level A log level
+ * @param[in] file A file name string
+ * @param[in] line A line number
+ * @param[in] message A message, not necessarily null-terminated
+ * @param[in] len The number of bytes of the message
+ */
+void logger_logMessage(LogLevel level, const char* file, int line, const char* message, size_t len);
+
+/**
+ * Log a hex dump of a buffer, one line per 16 bytes with the offset,
+ * the bytes in hex and the printable ones in ASCII:
+ * `0000  48 65 6c 6c 6f 0a 00 00  ...  |Hello...|`
+ * At most the first 4096 bytes are dumped, followed by a line counting the rest.
+ * An empty buffer is logged as `(0 bytes)`.
+ * Use LOG_HEX(), which checks the level first.
+ *
+ * @param[in] level A log level
+ * @param[in] file A file name string
+ * @param[in] line A line number
+ * @param[in] data The buffer
+ * @param[in] len The number of bytes of the buffer
+ */
+void logger_logHex(LogLevel level, const char* file, int line, const void* data, size_t len);
+
+/**
+ * Log a message from a call site. Use the LOG_* macros, which describe the site.
+ *
+ * @param[in] site A call site
+ * @param[in] fmt A format string
+ * @param[in] ... Additional arguments
+ */
+void logger_logSite(LogSite* site, const char* fmt, ...);
+
+/**
+ * Get the LOG_* call sites linked into the program with the library.
+ * The sites are registered at build time in the logger_sites section of ELF
+ * binaries; there are none elsewhere, and the sites of other shared objects
+ * and of C++ files are not included. Such sites follow the log level.
+ *
+ * @param[out] sites The first site
+ * @return The number of sites
+ */
+size_t logger_getSites(LogSite** sites);
+
+/**
+ * Switch a call site on or off regardless of the log level, or make it follow
+ * the level again.
+ *
+ * @param[in] site A call site
+ * @param[in] mode A mode
+ */
+void logger_setSite(LogSite* site, LogSiteMode mode);
+
+/**
+ * Switch the call sites matching a pattern, e.g. `conn.c:42`, `net/conn*.c` or `*`.
+ * The glob before an optional `:<line>` matches the file name of the site, or its
+ * whole path if the glob contains a '/'.
+ *
+ * @param[in] pattern A pattern
+ * @param[in] mode A mode
+ * @return The number of sites switched
+ */
+int logger_setSites(const char* pattern, LogSiteMode mode);
+
+/**
+ * Create a logger with its own console, file and socket loggers, level and lock,
+ * so that one component never waits for the lock or the I/O of another.
+ * The functions without a logger_t act on a default logger of their own.
+ * The format, the clock, auto flush, sanitizing, the flush level and the thread
+ * levels are shared by all loggers; deduplication, indexing, retention, per-thread
+ * files and the stats are of the default logger only.
+ *
+ * @return A logger at LogLevel_INFO without loggers, or NULL upon failure
+ */
+logger_t* logger_create(void);
+
+/**
+ * Flush and close the loggers of a logger and free it.
+ * No thread may log to it meanwhile.
+ *
+ * @param[in] logger A logger created by logger_create()
+ */
+void logger_destroy(logger_t* logger);
+
+/**
+ * Add a console logger to a logger, see logger_initConsoleLoggerEx().
+ *
+ * @param[in] logger A logger
+ * @param[in] output A file pointer. Make sure to set stdout or stderr.
+ * @param[in] options A combination of the LogConsoleOption flags, or 0
+ * @return Non-zero value upon success or 0 on error
+ */
+int logger_addConsole(logger_t* logger, FILE* output, int options);
+
+/**
+ * Add a file logger to a logger, see logger_initFileLoggerEx().
+ * LogFileOption_PER_THREAD is not supported.
+ *
+ * @param[in] logger A logger
+ * @param[in] filename A log file name
+ * @param[in] maxFileSize A maximum file size
+ * @param[in] maxBackupFiles A maximum number of backup files
+ * @param[in] options A combination of the LogFileOption flags, or 0
+ * @return Non-zero value upon success or 0 on error
+ */
+int logger_addFile(logger_t* logger, const char* filename, long maxFileSize,
+        unsigned char maxBackupFiles, int options);
+
+/**
+ * Add a socket logger to a logger, see logger_initSocketLogger().
+ *
+ * @param[in] logger A logger
+ * @param[in] path The path of the Unix domain socket of the collector
+ * @param[in] type The socket type
+ * @return Non-zero value upon success or 0 on error
+ */
+int logger_addSocket(logger_t* logger, const char* path, LogSocketType type);
+
+/**
+ * Set the log level of a logger.
+ *
+ * @param[in] logger A logger
+ * @param[in] level A log level
+ */
+void logger_setLoggerLevel(logger_t* logger, LogLevel level);
+
+/**
+ * Get the log level of a logger.
+ *
+ * @param[in] logger A logger
+ * @return The log level
+ */
+LogLevel logger_getLoggerLevel(logger_t* logger);
+
+/**
+ * Check whether a message at the level would be logged by a logger.
+ * The level set for the thread overrides the level of the logger.
+ *
+ * @param[in] logger A logger
+ * @param[in] level A log level
+ * @return Non-zero value if enabled or 0 if not
+ */
+int logger_isLoggerEnabled(logger_t* logger, LogLevel level);
+
+/**
+ * Log a message to a logger. Use the LOG_*_TO() macros.
+ *
+ * @param[in] logger A logger
+ * @param[in] level A log level
+ * @param[in] file A file name string
+ * @param[in] line A line number
+ * @param[in] fmt A format string
+ * @param[in] ... Additional arguments
+ */
+void logger_logTo(logger_t* logger, LogLevel level, const char* file, int line, const char* fmt, ...);
+
+/**
+ * Flush the buffered log messages of a logger.
+ *
+ * @param[in] logger A logger
+ */
+void logger_flushLogger(logger_t* logger);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif /* __cplusplus */
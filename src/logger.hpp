@@ -0,0 +1,593 @@
+#ifndef LOGGER_HPP
+#define LOGGER_HPP
+
+/*
+ * Type-safe C++ front end of the logger (C++11).
+ *
+ * LOGGER_INFO("%d items in %s", count, name);
+ * LOGGER_STREAM(LogLevel_INFO) << count << " items in " << name;
+ *
+ * The format string of LOGGER_* must be a string literal. It is checked against the
+ * arguments at compile time, and every argument is rendered by its actual type,
+ * so std::string and user types can be logged. A user type is loggable with `%s` or `<<` once it has an overload of
+ * `logger::Stream& operator<<(logger::Stream&, const T&)`.
+ * Length modifiers are accepted but not needed, and `*` widths are not supported.
+ *
+ * Messages are rendered into a buffer on the stack without heap allocation and
+ * written through the same path as logger_log(), so the output is identical.
+ * Messages longer than kMessageSize bytes are truncated.
+ */
+
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include "logger.h"
+
+#define LOGGER_TRACE(fmt, ...) LOGGER_CHECKED_LOG(LogLevel_TRACE, fmt, ##__VA_ARGS__)
+#define LOGGER_DEBUG(fmt, ...) LOGGER_CHECKED_LOG(LogLevel_DEBUG, fmt, ##__VA_ARGS__)
+#define LOGGER_INFO(fmt, ...)  LOGGER_CHECKED_LOG(LogLevel_INFO , fmt, ##__VA_ARGS__)
+#define LOGGER_WARN(fmt, ...)  LOGGER_CHECKED_LOG(LogLevel_WARN , fmt, ##__VA_ARGS__)
+#define LOGGER_ERROR(fmt, ...) LOGGER_CHECKED_LOG(LogLevel_ERROR, fmt, ##__VA_ARGS__)
+#define LOGGER_FATAL(fmt, ...) LOGGER_CHECKED_LOG(LogLevel_FATAL, fmt, ##__VA_ARGS__)
+
+#define LOGGER_CHECKED_LOG(level, fmt, ...) do { \
+    static_assert(::logger::detail::checkFormat(fmt, decltype(::logger::detail::typeList(__VA_ARGS__))()), \
+            "logger: the format string does not match the arguments"); \
+    if (LOGGER_UNLIKELY(LOGGER_ENABLED_LEVEL() <= (level))) { \
+        ::logger::log(level, __FILENAME__, __LINE__, fmt, ##__VA_ARGS__); \
+    } \
+} while (0)
+
+#define LOGGER_STREAM(level) \
+    !LOGGER_UNLIKELY(LOGGER_ENABLED_LEVEL() <= (level)) ? (void) 0 \
+            : ::logger::detail::Voidify() & ::logger::Message(level, __FILENAME__, __LINE__).stream()
+
+namespace logger {
+
+enum { kMessageSize = 4096 };
+
+namespace detail {
+
+/* Write the decimal digits of a value backwards from the end of a buffer */
+inline char* formatDecimal(char* end, unsigned long long value)
+{
+    static const char kDigits[] =
+        "00010203040506070809" "10111213141516171819" "20212223242526272829"
+        "30313233343536373839" "40414243444546474849" "50515253545556575859"
+        "60616263646566676869" "70717273747576777879" "80818283848586878889"
+        "90919293949596979899";
+    unsigned int i;
+
+    while (value >= 100) {
+        i = static_cast<unsigned int>(value % 100) * 2;
+        value /= 100;
+        *--end = kDigits[i + 1];
+        *--end = kDigits[i];
+    }
+    if (value < 10) {
+        *--end = static_cast<char>('0' + value);
+    } else {
+        i = static_cast<unsigned int>(value) * 2;
+        *--end = kDigits[i + 1];
+        *--end = kDigits[i];
+    }
+    return end;
+}
+
+} /* namespace detail */
+
+/* A text buffer of fixed capacity. Output beyond the capacity is discarded. */
+class Stream {
+public:
+    Stream(char* buf, std::size_t size) : m_buf(buf), m_capacity(size - 1), m_len(0) {}
+
+    const char* data() const { return m_buf; }
+    std::size_t size() const { return m_len; }
+
+    Stream& write(const char* s, std::size_t n)
+    {
+        if (n > m_capacity - m_len) {
+            n = m_capacity - m_len;
+        }
+        std::memcpy(m_buf + m_len, s, n);
+        m_len += n;
+        return *this;
+    }
+
+    Stream& put(char c)
+    {
+        if (m_len < m_capacity) {
+            m_buf[m_len++] = c;
+        }
+        return *this;
+    }
+
+    /* Render one value with a printf conversion specification */
+    template <typename T>
+    Stream& format(const char* spec, T value)
+    {
+        int n = std::snprintf(m_buf + m_len, m_capacity - m_len + 1, spec, value);
+        if (n > 0) {
+            m_len += (static_cast<std::size_t>(n) < m_capacity - m_len) ? n : m_capacity - m_len;
+        }
+        return *this;
+    }
+
+    Stream& writeUnsigned(unsigned long long value, bool negative = false)
+    {
+        char buf[24];
+        char* end = buf + sizeof(buf);
+        char* p = detail::formatDecimal(end, value);
+        if (negative) {
+            *--p = '-';
+        }
+        return write(p, end - p);
+    }
+
+    Stream& writeSigned(long long value)
+    {
+        return (value < 0) ? writeUnsigned(0ULL - static_cast<unsigned long long>(value), true)
+                           : writeUnsigned(static_cast<unsigned long long>(value));
+    }
+
+    Stream& writeHex(unsigned long long value, bool upper)
+    {
+        const char* digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+        char buf[16];
+        char* end = buf + sizeof(buf);
+        char* p = end;
+        do {
+            *--p = digits[value & 0xf];
+            value >>= 4;
+        } while (value != 0);
+        return write(p, end - p);
+    }
+
+    Stream& operator<<(const char* s) { return (s != NULL) ? write(s, std::strlen(s)) : write("(null)", 6); }
+    Stream& operator<<(const std::string& s) { return write(s.data(), s.size()); }
+    Stream& operator<<(char c) { return put(c); }
+    Stream& operator<<(signed char c) { return put(static_cast<char>(c)); }
+    Stream& operator<<(unsigned char c) { return put(static_cast<char>(c)); }
+    Stream& operator<<(bool b) { return put(b ? '1' : '0'); }
+    Stream& operator<<(short v) { return writeSigned(v); }
+    Stream& operator<<(unsigned short v) { return writeUnsigned(v); }
+    Stream& operator<<(int v) { return writeSigned(v); }
+    Stream& operator<<(unsigned int v) { return writeUnsigned(v); }
+    Stream& operator<<(long v) { return writeSigned(v); }
+    Stream& operator<<(unsigned long v) { return writeUnsigned(v); }
+    Stream& operator<<(long long v) { return writeSigned(v); }
+    Stream& operator<<(unsigned long long v) { return writeUnsigned(v); }
+    Stream& operator<<(float v) { return format("%g", static_cast<double>(v)); }
+    Stream& operator<<(double v) { return format("%g", v); }
+    Stream& operator<<(long double v) { return format("%Lg", v); }
+    Stream& operator<<(const void* p) { return format("%p", p); }
+
+private:
+    char* m_buf;
+    std::size_t m_capacity; /* without null character */
+    std::size_t m_len;
+};
+
+namespace detail {
+
+/* ---- Compile-time format checking ---- */
+
+template <typename... T> struct TypeList {};
+
+/* Declared only: used in decltype to collect the decayed argument types */
+template <typename... T>
+TypeList<typename std::decay<T>::type...> typeList(T&&...);
+
+template <typename T>
+struct IsStreamable {
+    template <typename U>
+    static auto test(int) -> decltype(std::declval<Stream&>() << std::declval<const U&>(), std::true_type());
+    template <typename U>
+    static std::false_type test(...);
+    static const bool value = std::is_class<T>::value && decltype(test<T>(0))::value;
+};
+
+template <typename T>
+struct IsCString {
+    static const bool value = std::is_same<T, char*>::value || std::is_same<T, const char*>::value;
+};
+
+template <typename T>
+struct IsInteger {
+    static const bool value = std::is_integral<T>::value || std::is_enum<T>::value;
+};
+
+template <typename T>
+struct Accepts {
+    static constexpr bool conversion(char c)
+    {
+        return (c == 'd' || c == 'i' || c == 'u' || c == 'x' || c == 'X' || c == 'o' || c == 'c')
+                    ? IsInteger<T>::value
+            : (c == 'f' || c == 'F' || c == 'e' || c == 'E' || c == 'g' || c == 'G' || c == 'a' || c == 'A')
+                    ? std::is_floating_point<T>::value
+            : (c == 's')
+                    ? IsCString<T>::value || std::is_same<T, std::string>::value
+                            || std::is_same<T, std::nullptr_t>::value || IsStreamable<T>::value
+            : (c == 'p')
+                    ? std::is_pointer<T>::value || std::is_same<T, std::nullptr_t>::value
+            : false;
+    }
+};
+
+constexpr bool isFlag(char c) { return c == '-' || c == '+' || c == ' ' || c == '#' || c == '0'; }
+constexpr bool isDigit(char c) { return c >= '0' && c <= '9'; }
+constexpr bool isLength(char c) { return c == 'h' || c == 'l' || c == 'L' || c == 'q' || c == 'j' || c == 'z' || c == 't'; }
+constexpr const char* skipFlags(const char* p) { return isFlag(*p) ? skipFlags(p + 1) : p; }
+constexpr const char* skipDigits(const char* p) { return isDigit(*p) ? skipDigits(p + 1) : p; }
+constexpr const char* skipPrecision(const char* p) { return (*p == '.') ? skipDigits(p + 1) : p; }
+constexpr const char* skipLength(const char* p) { return isLength(*p) ? skipLength(p + 1) : p; }
+
+/* Find the conversion character of the specification following '%' */
+constexpr const char* findConversion(const char* p)
+{
+    return skipLength(skipPrecision(skipDigits(skipFlags(p))));
+}
+
+template <typename... T> struct Checker;
+
+template <>
+struct Checker<> {
+    static constexpr bool check(const char* p)
+    {
+        return (*p == '\0') ? true
+            : (*p != '%') ? check(p + 1)
+            : (p[1] == '%') ? check(p + 2)
+            : false; /* too few arguments */
+    }
+};
+
+template <typename T, typename... Rest>
+struct Checker<T, Rest...> {
+    static constexpr bool check(const char* p)
+    {
+        return (*p == '\0') ? false /* too many arguments */
+            : (*p != '%') ? check(p + 1)
+            : (p[1] == '%') ? check(p + 2)
+            : Accepts<T>::conversion(*findConversion(p + 1))
+                    && Checker<Rest...>::check(findConversion(p + 1) + 1);
+    }
+};
+
+template <typename... T>
+constexpr bool checkFormat(const char* fmt, TypeList<T...>)
+{
+    return Checker<T...>::check(fmt);
+}
+
+/* ---- Rendering ---- */
+
+struct Spec {
+    const char* begin; /* the first character after '%' */
+    const char* end; /* the end of the flags, width and precision */
+    char conversion;
+    bool simple; /* without flags, width and precision */
+};
+
+/* Copy the literal text up to the next conversion and return its '%' or the terminator */
+inline const char* copyLiteral(Stream& stream, const char* p)
+{
+    const char* q;
+
+    for (;;) {
+        for (q = p; *q != '\0' && *q != '%'; q++) {}
+        stream.write(p, q - p);
+        if (*q == '\0' || q[1] != '%') {
+            return q;
+        }
+        stream.put('%');
+        p = q + 2;
+    }
+}
+
+inline const char* parseSpec(const char* p, Spec* spec)
+{
+    spec->begin = p;
+    spec->end = skipPrecision(skipDigits(skipFlags(p)));
+    spec->simple = (spec->end == p);
+    p = skipLength(spec->end);
+    spec->conversion = *p;
+    return (*p != '\0') ? p + 1 : p;
+}
+
+/* Rebuild the specification for snprintf() with a length modifier of the rendered type */
+inline void makeSpec(char* out, std::size_t size, const Spec& spec, const char* length, char conversion)
+{
+    std::size_t n = spec.end - spec.begin;
+    std::size_t lengthlen = std::strlen(length);
+
+    if (n + lengthlen + 3 > size) {
+        n = 0; /* ignore unreasonably long widths */
+    }
+    *out++ = '%';
+    std::memcpy(out, spec.begin, n);
+    out += n;
+    std::memcpy(out, length, lengthlen);
+    out += lengthlen;
+    *out++ = conversion;
+    *out = '\0';
+}
+
+typedef std::integral_constant<int, 0> IntegerTag;
+typedef std::integral_constant<int, 1> FloatingTag;
+typedef std::integral_constant<int, 2> CStringTag;
+typedef std::integral_constant<int, 3> StringTag;
+typedef std::integral_constant<int, 4> PointerTag;
+typedef std::integral_constant<int, 5> NullTag;
+typedef std::integral_constant<int, 6> OtherTag;
+
+template <typename T>
+struct Category : std::integral_constant<int,
+        IsInteger<T>::value ? 0
+        : std::is_floating_point<T>::value ? 1
+        : IsCString<T>::value ? 2
+        : std::is_same<T, std::string>::value ? 3
+        : std::is_pointer<T>::value ? 4
+        : std::is_same<T, std::nullptr_t>::value ? 5
+        : 6> {};
+
+/* Integers are promoted like C varargs: bool, char and short become int */
+template <typename T>
+struct Promoted {
+    typedef typename std::conditional<std::is_enum<T>::value, long long,
+            typename std::conditional<(sizeof(T) < sizeof(int)), int, T>::type>::type type;
+};
+
+template <typename T>
+void formatInteger(Stream& stream, const Spec& spec, T value)
+{
+    typedef typename Promoted<T>::type P;
+    typedef typename std::make_unsigned<P>::type U;
+    char fmt[40];
+    P v = static_cast<P>(value);
+
+    switch (spec.conversion) {
+        case 'c':
+            if (spec.simple) {
+                stream.put(static_cast<char>(v));
+            } else {
+                makeSpec(fmt, sizeof(fmt), spec, "", 'c');
+                stream.format(fmt, static_cast<int>(v));
+            }
+            break;
+        case 'u':
+        case 'x':
+        case 'X':
+        case 'o':
+            if (spec.simple && spec.conversion == 'u') {
+                stream.writeUnsigned(static_cast<U>(v));
+            } else if (spec.simple && spec.conversion != 'o') {
+                stream.writeHex(static_cast<U>(v), spec.conversion == 'X');
+            } else {
+                makeSpec(fmt, sizeof(fmt), spec, "ll", spec.conversion);
+                stream.format(fmt, static_cast<unsigned long long>(static_cast<U>(v)));
+            }
+            break;
+        default:
+            if (spec.simple) {
+                if (std::is_signed<P>::value) {
+                    stream.writeSigned(static_cast<long long>(v));
+                } else {
+                    stream.writeUnsigned(static_cast<unsigned long long>(v));
+                }
+            } else if (std::is_signed<P>::value) {
+                makeSpec(fmt, sizeof(fmt), spec, "ll", 'd');
+                stream.format(fmt, static_cast<long long>(v));
+            } else {
+                makeSpec(fmt, sizeof(fmt), spec, "ll", 'u');
+                stream.format(fmt, static_cast<unsigned long long>(v));
+            }
+            break;
+    }
+}
+
+template <typename T>
+void formatArg(Stream& stream, const Spec& spec, const T& value, IntegerTag)
+{
+    formatInteger(stream, spec, value);
+}
+
+inline void formatFloating(Stream& stream, const Spec& spec, double value)
+{
+    char fmt[40];
+
+    makeSpec(fmt, sizeof(fmt), spec, "", std::strchr("fFeEgGaA", spec.conversion) ? spec.conversion : 'g');
+    stream.format(fmt, value);
+}
+
+inline void formatFloating(Stream& stream, const Spec& spec, long double value)
+{
+    char fmt[40];
+
+    makeSpec(fmt, sizeof(fmt), spec, "L", std::strchr("fFeEgGaA", spec.conversion) ? spec.conversion : 'g');
+    stream.format(fmt, value);
+}
+
+template <typename T>
+void formatArg(Stream& stream, const Spec& spec, const T& value, FloatingTag)
+{
+    formatFloating(stream, spec, static_cast<typename std::conditional<
+            std::is_same<T, long double>::value, long double, double>::type>(value));
+}
+
+inline void formatString(Stream& stream, const Spec& spec, const char* s, std::size_t len)
+{
+    char fmt[40];
+
+    if (spec.simple || spec.conversion != 's') {
+        stream.write(s, len);
+    } else {
+        makeSpec(fmt, sizeof(fmt), spec, "", 's');
+        stream.format(fmt, s);
+    }
+}
+
+inline void formatArg(Stream& stream, const Spec& spec, const char* value, CStringTag)
+{
+    if (value == NULL) {
+        formatString(stream, spec, "(null)", 6);
+    } else if (spec.conversion == 'p') {
+        stream.format("%p", static_cast<const void*>(value));
+    } else {
+        formatString(stream, spec, value, std::strlen(value));
+    }
+}
+
+template <typename T>
+void formatArg(Stream& stream, const Spec& spec, const T& value, StringTag)
+{
+    if (spec.simple || spec.conversion != 's') {
+        stream.write(value.data(), value.size());
+    } else {
+        formatString(stream, spec, value.c_str(), value.size());
+    }
+}
+
+template <typename T>
+void formatArg(Stream& stream, const Spec& spec, const T& value, PointerTag)
+{
+    char fmt[40];
+
+    makeSpec(fmt, sizeof(fmt), spec, "", 'p');
+    stream.format(fmt, static_cast<const void*>(value));
+}
+
+template <typename T>
+void formatArg(Stream& stream, const Spec& spec, const T&, NullTag)
+{
+    if (spec.conversion == 's') {
+        formatString(stream, spec, "(null)", 6);
+    } else {
+        formatArg(stream, spec, static_cast<const void*>(NULL), PointerTag());
+    }
+}
+
+template <typename T>
+void formatArg(Stream& stream, const Spec&, const T& value, OtherTag)
+{
+    static_assert(IsStreamable<T>::value,
+            "logger: define logger::Stream& operator<<(logger::Stream&, const T&) to log this type");
+    stream << value;
+}
+
+inline void format(Stream& stream, const char* fmt)
+{
+    fmt = copyLiteral(stream, fmt);
+    stream << fmt; /* conversions without arguments are written as they are */
+}
+
+template <typename T, typename... Rest>
+void format(Stream& stream, const char* fmt, const T& value, const Rest&... rest)
+{
+    Spec spec;
+
+    fmt = copyLiteral(stream, fmt);
+    if (*fmt == '\0') {
+        return; /* extra arguments are ignored */
+    }
+    fmt = parseSpec(fmt + 1, &spec);
+    formatArg(stream, spec, value, Category<typename std::decay<T>::type>());
+    format(stream, fmt, rest...);
+}
+
+struct Voidify {
+    void operator&(Stream&) {}
+};
+
+} /* namespace detail */
+
+/**
+ * Log a message formatted with type-safe printf-style conversions.
+ * Prefer the LOGGER_* macros, which check the format string at compile time
+ * and skip the call if the level is disabled.
+ */
+template <typename... Args>
+void log(LogLevel level, const char* file, int line, const char* fmt, const Args&... args)
+{
+    char buf[kMessageSize];
+    Stream stream(buf, sizeof(buf));
+
+    detail::format(stream, fmt, args...);
+    logger_logMessage(level, file, line, stream.data(), stream.size());
+}
+
+/* A message built with operator<< and logged when it goes out of scope */
+class Message {
+public:
+    Message(LogLevel level, const char* file, int line)
+        : m_level(level), m_file(file), m_line(line), m_stream(m_buf, sizeof(m_buf)) {}
+
+    ~Message()
+    {
+        logger_logMessage(m_level, m_file, m_line, m_stream.data(), m_stream.size());
+    }
+
+    Stream& stream() { return m_stream; }
+
+private:
+    Message(const Message&) = delete;
+    Message& operator=(const Message&) = delete;
+
+    LogLevel m_level;
+    const char* m_file;
+    int m_line;
+    char m_buf[kMessageSize];
+    Stream m_stream;
+};
+
+/*
+ * Override the log level of the calling thread for a scope, e.g. one request.
+ * The previous level of the thread is restored at the end of the scope.
+ *
+ * logger::ThreadLevel trace(LogLevel_TRACE);
+ */
+class ThreadLevel {
+public:
+    explicit ThreadLevel(LogLevel level)
+        : m_hadLevel(logger_getThreadLevel(&m_previous) != 0)
+    {
+        logger_setThreadLevel(level);
+    }
+
+    ~ThreadLevel()
+    {
+        if (m_hadLevel) {
+            logger_setThreadLevel(m_previous);
+        } else {
+            logger_clearThreadLevel();
+        }
+    }
+
+private:
+    ThreadLevel(const ThreadLevel&) = delete;
+    ThreadLevel& operator=(const ThreadLevel&) = delete;
+
+    LogLevel m_previous = LogLevel_INFO;
+    bool m_hadLevel;
+};
+
+/*
+ * Push a key and value onto the context of the calling thread for a scope.
+ *
+ * logger::Context context("req", requestID.c_str());
+ */
+class Context {
+public:
+    Context(const char* key, const char* value) { logger_pushContext(key, value); }
+    ~Context() { logger_popContext(); }
+
+private:
+    Context(const Context&) = delete;
+    Context& operator=(const Context&) = delete;
+};
+
+} /* namespace logger */
+
+#endif /* LOGGER_HPP */
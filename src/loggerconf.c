@@ -10,6 +10,7 @@ enum {
     /* Logger type */
     kConsoleLogger = 1 << 0,
     kFileLogger = 1 << 1,
+    kSocketLogger = 1 << 2,
 
     kMaxFileNameLen = 256,
     kMaxLineLen = 512,
@@ -18,6 +19,8 @@ enum {
 /* Console logger */
 static struct {
     FILE* output;
+    int options;
+    int deduplicate;
 } s_clog;
 
 /* File logger */
@@ -25,9 +28,24 @@ static struct {
     char filename[kMaxFileNameLen];
     long maxFileSize;
     unsigned char maxBackupFiles;
+    unsigned long long maxTotalSize;
+    long maxAge;
+    int options;
+    int deduplicate;
 } s_flog;
 
+/* Socket logger */
+static struct {
+    char path[kMaxFileNameLen];
+    LogSocketType type;
+    int deduplicate;
+} s_slog;
+
 static int s_logger;
+static LogLevel s_flushLevel;
+static int s_syncFlush;
+static LogLevel s_keepLevel;
+static size_t s_keepSize;
 
 static void reset(void);
 static void removeComments(char* s);
@@ -61,26 +79,48 @@ int logger_configure(const char* filename)
     fclose(fp);
 
     if (hasFlag(s_logger, kConsoleLogger)) {
-        if (!logger_initConsoleLogger(s_clog.output)) {
+        if (!logger_initConsoleLoggerEx(s_clog.output, s_clog.options)) {
             return 0;
         }
     }
     if (hasFlag(s_logger, kFileLogger)) {
-        if (!logger_initFileLogger(s_flog.filename, s_flog.maxFileSize, s_flog.maxBackupFiles)) {
+        if (!logger_initFileLoggerEx(s_flog.filename, s_flog.maxFileSize, s_flog.maxBackupFiles,
+                s_flog.options)) {
+            return 0;
+        }
+        if ((s_flog.maxTotalSize > 0 || s_flog.maxAge > 0)
+                && !logger_retainFiles(s_flog.maxTotalSize, s_flog.maxAge)) {
+            return 0;
+        }
+    }
+    if (hasFlag(s_logger, kSocketLogger)) {
+        if (!logger_initSocketLogger(s_slog.path, s_slog.type)) {
             return 0;
         }
     }
     if (s_logger == 0) {
         return 0;
     }
+    logger_deduplicate((s_clog.deduplicate ? LogSink_CONSOLE : 0)
+            | (s_flog.deduplicate ? LogSink_FILE : 0)
+            | (s_slog.deduplicate ? LogSink_SOCKET : 0));
+    logger_flushLevel(s_flushLevel, s_syncFlush);
+    if (s_keepSize > 0 && !logger_keepContext(s_keepLevel, s_keepSize)) {
+        return 0;
+    }
     return 1;
 }
 
 static void reset(void)
 {
     s_logger = 0;
+    s_flushLevel = LogLevel_ERROR;
+    s_syncFlush = 0;
+    s_keepLevel = LogLevel_DEBUG;
+    s_keepSize = 0;
     memset(&s_clog, 0, sizeof(s_clog));
     memset(&s_flog, 0, sizeof(s_flog));
+    memset(&s_slog, 0, sizeof(s_slog));
 }
 
 static void removeComments(char* s)
@@ -116,6 +156,10 @@ static void trim(char* s)
 }
 
 static LogLevel parseLevel(const char* s);
+static LogClock parseClock(const char* s);
+static int parseBool(const char* key, const char* s);
+static int parseDurability(const char* s);
+static void setOption(int* options, int option, int enabled);
 
 static void parseLine(char* line)
 {
@@ -123,17 +167,37 @@ static void parseLine(char* line)
     int nfiles;
 
     key = strtok(line, "=");
-    val = strtok(NULL, "=");
+    val = strtok(NULL, ""); /* a format may contain '=' */
 
     if (strcmp(key, "level") == 0) {
         logger_setLevel(parseLevel(val));
     } else if (strcmp(key, "autoFlush") == 0) {
         logger_autoFlush(atol(val));
+    } else if (strcmp(key, "clock") == 0) {
+        logger_setClock(parseClock(val));
+    } else if (strcmp(key, "format") == 0) {
+        logger_setFormat(val);
+    } else if (strcmp(key, "flushLevel") == 0) {
+        s_flushLevel = parseLevel(val);
+    } else if (strcmp(key, "syncFlush") == 0) {
+        s_syncFlush = parseBool(key, val);
+    } else if (strcmp(key, "keepContext") == 0) {
+        s_keepLevel = parseLevel(val);
+    } else if (strcmp(key, "keepContextSize") == 0) {
+        s_keepSize = strtoul(val, NULL, 10);
+    } else if (strcmp(key, "enableSites") == 0) {
+        logger_setSites(val, LogSite_ON);
+    } else if (strcmp(key, "disableSites") == 0) {
+        logger_setSites(val, LogSite_OFF);
+    } else if (strcmp(key, "sanitize") == 0) {
+        logger_sanitize(parseBool(key, val));
     } else if (strcmp(key, "logger") == 0) {
         if (strcmp(val, "console") == 0) {
             s_logger |= kConsoleLogger;
         } else if (strcmp(val, "file") == 0) {
             s_logger |= kFileLogger;
+        } else if (strcmp(val, "socket") == 0) {
+            s_logger |= kSocketLogger;
         } else {
             fprintf(stderr, "ERROR: loggerconf: Invalid logger: `%s`\n", val);
             s_logger = 0;
@@ -147,6 +211,12 @@ static void parseLine(char* line)
             fprintf(stderr, "ERROR: loggerconf: Invalid logger.console.output: `%s`\n", val);
             s_clog.output = NULL;
         }
+    } else if (strcmp(key, "logger.console.async") == 0) {
+        setOption(&s_clog.options, LogConsoleOption_ASYNC, parseBool(key, val));
+    } else if (strcmp(key, "logger.console.color") == 0) {
+        setOption(&s_clog.options, LogConsoleOption_COLOR, parseBool(key, val));
+    } else if (strcmp(key, "logger.console.deduplicate") == 0) {
+        s_clog.deduplicate = parseBool(key, val);
     } else if (strcmp(key, "logger.file.filename") == 0) {
         strncpy(s_flog.filename, val, sizeof(s_flog.filename));
     } else if (strcmp(key, "logger.file.maxFileSize") == 0) {
@@ -158,6 +228,39 @@ static void parseLine(char* line)
             nfiles = 0;
         }
         s_flog.maxBackupFiles = nfiles;
+    } else if (strcmp(key, "logger.file.maxTotalSize") == 0) {
+        s_flog.maxTotalSize = strtoul(val, NULL, 10);
+    } else if (strcmp(key, "logger.file.maxAge") == 0) {
+        s_flog.maxAge = atol(val);
+    } else if (strcmp(key, "logger.file.shared") == 0) {
+        setOption(&s_flog.options, LogFileOption_SHARED, parseBool(key, val));
+    } else if (strcmp(key, "logger.file.preallocate") == 0) {
+        setOption(&s_flog.options, LogFileOption_PREALLOCATE, parseBool(key, val));
+    } else if (strcmp(key, "logger.file.direct") == 0) {
+        setOption(&s_flog.options, LogFileOption_DIRECT, parseBool(key, val));
+    } else if (strcmp(key, "logger.file.perThread") == 0) {
+        setOption(&s_flog.options, LogFileOption_PER_THREAD, parseBool(key, val));
+    } else if (strcmp(key, "logger.file.adaptive") == 0) {
+        setOption(&s_flog.options, LogFileOption_ADAPTIVE, parseBool(key, val));
+    } else if (strcmp(key, "logger.file.durability") == 0) {
+        s_flog.options &= ~(LogFileOption_SYNC_PERIODIC | LogFileOption_SYNC_GROUP);
+        s_flog.options |= parseDurability(val);
+    } else if (strcmp(key, "logger.file.index") == 0) {
+        logger_indexFile(atol(val));
+    } else if (strcmp(key, "logger.file.deduplicate") == 0) {
+        s_flog.deduplicate = parseBool(key, val);
+    } else if (strcmp(key, "logger.socket.path") == 0) {
+        strncpy(s_slog.path, val, sizeof(s_slog.path));
+    } else if (strcmp(key, "logger.socket.type") == 0) {
+        if (strcmp(val, "dgram") == 0) {
+            s_slog.type = LogSocket_DGRAM;
+        } else if (strcmp(val, "stream") == 0) {
+            s_slog.type = LogSocket_STREAM;
+        } else {
+            fprintf(stderr, "ERROR: loggerconf: Invalid logger.socket.type: `%s`\n", val);
+        }
+    } else if (strcmp(key, "logger.socket.deduplicate") == 0) {
+        s_slog.deduplicate = parseBool(key, val);
     }
 }
 
@@ -181,6 +284,55 @@ static LogLevel parseLevel(const char* s)
     }
 }
 
+static LogClock parseClock(const char* s)
+{
+    if (strcmp(s, "realtime") == 0) {
+        return LogClock_REALTIME;
+    } else if (strcmp(s, "monotonic") == 0) {
+        return LogClock_MONOTONIC;
+    } else if (strcmp(s, "tsc") == 0) {
+        return LogClock_TSC;
+    } else {
+        fprintf(stderr, "ERROR: loggerconf: Invalid clock: `%s`\n", s);
+        return logger_getClock();
+    }
+}
+
+static int parseBool(const char* key, const char* s)
+{
+    if (strcmp(s, "true") == 0) {
+        return 1;
+    } else if (strcmp(s, "false") == 0) {
+        return 0;
+    } else {
+        fprintf(stderr, "ERROR: loggerconf: Invalid %s: `%s`\n", key, s);
+        return 0;
+    }
+}
+
+static int parseDurability(const char* s)
+{
+    if (strcmp(s, "none") == 0) {
+        return 0;
+    } else if (strcmp(s, "periodic") == 0) {
+        return LogFileOption_SYNC_PERIODIC;
+    } else if (strcmp(s, "group") == 0) {
+        return LogFileOption_SYNC_GROUP;
+    } else {
+        fprintf(stderr, "ERROR: loggerconf: Invalid durability: `%s`\n", s);
+        return 0;
+    }
+}
+
+static void setOption(int* options, int option, int enabled)
+{
+    if (enabled) {
+        *options |= option;
+    } else {
+        *options &= ~option;
+    }
+}
+
 static int hasFlag(int flags, int flag)
 {
     return (flags & flag) == flag;
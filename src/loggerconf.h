@@ -14,11 +14,36 @@ extern "C" {
  * |:--------------------------|:--------------------------------------------|
  * |level                      |TRACE, DEBUG, INFO, WARN, ERROR or FATAL     |
  * |autoFlush                  |A flush interval [ms] (off if interval <= 0) |
- * |logger                     |console or file                              |
+ * |clock                      |realtime, monotonic or tsc                   |
+ * |format                     |A line format (see logger_setFormat())       |
+ * |flushLevel                 |A level written through at once              |
+ * |syncFlush                  |true or false (also sync such lines)         |
+ * |keepContext                |A level kept per thread until an error       |
+ * |keepContextSize            |Bytes kept per thread (off if 0)             |
+ * |enableSites                |Sites logging at any level: <glob>[:<line>]  |
+ * |disableSites               |Sites never logging: <glob>[:<line>]         |
+ * |sanitize                   |true or false (escape control characters)    |
+ * |logger                     |console, file or socket                      |
  * |logger.console.output      |stdout or stderr                             |
+ * |logger.console.async       |true or false (write on a thread of its own) |
+ * |logger.console.color       |true or false (color by level on a terminal) |
+ * |logger.console.deduplicate |true or false                                |
  * |logger.file.filename       |A output filename (max length is 255 bytes)  |
  * |logger.file.maxFileSize    |1-LONG_MAX [bytes] (1 MB if size <= 0)       |
  * |logger.file.maxBackupFiles |0-255                                        |
+ * |logger.file.maxTotalSize   |Bytes of all backups (no limit if 0)         |
+ * |logger.file.maxAge         |Seconds a backup is kept (no limit if <= 0)  |
+ * |logger.file.shared         |true or false (shared by processes)          |
+ * |logger.file.preallocate    |true or false (reserve maxFileSize bytes)    |
+ * |logger.file.direct         |true or false (write with O_DIRECT)          |
+ * |logger.file.perThread      |true or false (one file per thread)          |
+ * |logger.file.adaptive       |true or false (batch writes by load)         |
+ * |logger.file.durability     |none, periodic or group (fdatasync policy)   |
+ * |logger.file.index          |Index interval [bytes] (off if <= 0)         |
+ * |logger.file.deduplicate    |true or false                                |
+ * |logger.socket.path         |A Unix domain socket path (max 107 bytes)    |
+ * |logger.socket.type         |dgram or stream                              |
+ * |logger.socket.deduplicate  |true or false                                |
  *
  * @param[in] filename The name of the configuration file
  * @return Non-zero value upon success or 0 on error
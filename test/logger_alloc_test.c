@@ -0,0 +1,76 @@
+#include "logger.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "nanounit.h"
+
+/* Linked with -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc to count the allocations */
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t n, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+
+static const char kOutputFileName[] = "alloc.log";
+static volatile int s_allocations;
+
+void* __wrap_malloc(size_t size)
+{
+    s_allocations++;
+    return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t n, size_t size)
+{
+    s_allocations++;
+    return __real_calloc(n, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size)
+{
+    s_allocations++;
+    return __real_realloc(ptr, size);
+}
+
+static void logLines(const char* longMessage, int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++) {
+        LOG_INFO("short message %d", i);
+        LOG_INFO("%s", &longMessage[i % 1000]);
+        logger_logMessage(LogLevel_INFO, __FILENAME__, __LINE__, longMessage, strlen(longMessage));
+    }
+}
+
+static int test_noAllocationAfterWarmUp(void)
+{
+    char* longMessage;
+
+    /* setup: */
+    remove(kOutputFileName);
+    nu_assert(logger_initFileLogger(kOutputFileName, 0, 0));
+    if ((longMessage = (char*) __real_malloc(20000)) == NULL) {
+        nu_fail();
+    }
+    memset(longMessage, 'x', 19999);
+    longMessage[19999] = '\0';
+
+    /* when: log short and long lines after warming up */
+    logLines(longMessage, 10);
+    s_allocations = 0;
+    logLines(longMessage, 10000);
+
+    /* then: */
+    nu_assert_eq_int(0, s_allocations);
+
+    /* cleanup: */
+    logger_exitFileLogger();
+    free(longMessage);
+    remove(kOutputFileName);
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    nu_run_test(test_noAllocationAfterWarmUp);
+    nu_report();
+}
@@ -0,0 +1,100 @@
+#include "logger.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "nanounit.h"
+
+static const char kOutputFileName[] = "clock.log";
+static const double kTolerance = 5; /* sec */
+
+static void setup(void)
+{
+    remove(kOutputFileName);
+}
+
+static void cleanup(void)
+{
+    remove(kOutputFileName);
+}
+
+static int checkTimestamp(const char* line)
+{
+    time_t now = time(NULL);
+    struct tm calendar;
+    time_t stamped;
+
+    /* then: the timestamp is within a few seconds of the wall clock */
+    memset(&calendar, 0, sizeof(calendar));
+    nu_assert_eq_int(6, sscanf(&line[2], "%d-%d-%d %d:%d:%d", &calendar.tm_year, &calendar.tm_mon,
+            &calendar.tm_mday, &calendar.tm_hour, &calendar.tm_min, &calendar.tm_sec));
+    calendar.tm_year += 100;
+    calendar.tm_mon -= 1;
+    calendar.tm_isdst = -1;
+    stamped = mktime(&calendar);
+    nu_assert(difftime(now, stamped) >= -kTolerance && difftime(now, stamped) <= kTolerance);
+    nu_assert_eq_int('.', line[19]);
+    return 0;
+}
+
+static int logWithClock(LogClock clock)
+{
+    const char message[] = "message";
+    FILE* fp;
+    char line[256];
+    int result;
+
+    /* when: set the clock */
+    result = logger_setClock(clock);
+
+    /* then: ok */
+    nu_assert_eq_int(1, result);
+    nu_assert_eq_int(clock, logger_getClock());
+
+    /* when: output to the file */
+    remove(kOutputFileName);
+    logger_initFileLogger(kOutputFileName, 0, 0);
+    LOG_INFO(message);
+    logger_flush();
+
+    /* then: the line is stamped with the current time */
+    if ((fp = fopen(kOutputFileName, "r")) == NULL) {
+        nu_fail();
+    }
+    if (fgets(line, sizeof(line), fp) == NULL) {
+        fclose(fp);
+        nu_fail();
+    }
+    fclose(fp);
+    return checkTimestamp(line);
+}
+
+static int test_realtime(void)
+{
+    return logWithClock(LogClock_REALTIME);
+}
+
+static int test_monotonic(void)
+{
+    return logWithClock(LogClock_MONOTONIC);
+}
+
+static int test_tsc(void)
+{
+#if defined(__i386__) || defined(__x86_64__) || defined(_M_IX86) || defined(_M_X64)
+    return logWithClock(LogClock_TSC);
+#else
+    return 0;
+#endif
+}
+
+int main(int argc, char* argv[])
+{
+    setup();
+    nu_run_test(test_realtime);
+    nu_run_test(test_monotonic);
+    nu_run_test(test_tsc);
+    logger_exitFileLogger();
+    cleanup();
+    nu_report();
+}
@@ -4,6 +4,8 @@
  #include <io.h>
 #else
  #include <fcntl.h>
+ #include <poll.h>
+ #include <signal.h>
  #include <unistd.h>
 #endif /* defined(_WIN32) || defined(_WIN64) */
 #include "nanounit.h"
@@ -15,15 +17,36 @@
 #endif /* defined(_WIN32) || defined(_WIN64) */
 
 static const char kOutputFileName[] = "console.log";
+static const char kFileLoggerName[] = "console_file.log";
 
 static void setup(void)
 {
     remove(kOutputFileName);
+    remove(kFileLoggerName);
 }
 
 static void cleanup(void)
 {
     remove(kOutputFileName);
+    remove(kFileLoggerName);
+}
+
+static int countLines(const char* filename, const char* message)
+{
+    FILE* fp;
+    char line[256];
+    int count = 0;
+
+    if ((fp = fopen(filename, "r")) == NULL) {
+        return -1;
+    }
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if (strstr(line, message) != NULL && strchr(line, '\033') == NULL) {
+            count++;
+        }
+    }
+    fclose(fp);
+    return count;
 }
 
 static int test_consoleLogger(void)
@@ -77,10 +100,124 @@ static int test_consoleLogger(void)
     return 0;
 }
 
+#if !defined(_WIN32) && !defined(_WIN64)
+static int test_asyncConsoleLogger(void)
+{
+    int stdoutfd;
+    FILE* redirect;
+    int i;
+
+    /* setup: redirect stdout to a file */
+    stdoutfd = dup(1);
+    if ((redirect = fopen(kOutputFileName, "w")) == NULL) {
+        nu_fail();
+    }
+    dup2(fileno(redirect), 1);
+
+    /* when: log through the writer thread, colored only on a terminal */
+    nu_assert(logger_initConsoleLoggerEx(stdout, LogConsoleOption_ASYNC | LogConsoleOption_COLOR));
+    for (i = 0; i < 1000; i++) {
+        LOG_INFO("async message %d", i);
+    }
+    logger_flush();
+
+    /* then: every line has been written without colors */
+    nu_assert_eq_int(1000, countLines(kOutputFileName, "async message"));
+
+    /* cleanup: stop the writer and restore original stdout */
+    logger_initConsoleLogger(stdout);
+    dup2(stdoutfd, 1);
+    fclose(redirect);
+    close(stdoutfd);
+    return 0;
+}
+
+static int test_stalledConsole(void)
+{
+    const int lines = 50000;
+    int stdoutfd;
+    int fds[2];
+    LogStats stats;
+    int i;
+
+    /* setup: redirect stdout to a pipe nobody reads */
+    stdoutfd = dup(1);
+    if (pipe(fds) != 0) {
+        nu_fail();
+    }
+    dup2(fds[1], 1);
+    signal(SIGPIPE, SIG_IGN);
+    nu_assert(logger_initConsoleLoggerEx(stdout, LogConsoleOption_ASYNC));
+    nu_assert(logger_initFileLogger(kFileLoggerName, 64 * 1024 * 1024, 0));
+
+    /* when: log far more than the pipe and the console buffer hold */
+    for (i = 0; i < lines; i++) {
+        LOG_INFO("stalled message %d", i);
+    }
+    logger_exitFileLogger();
+
+    /* then: the file logger has not been blocked, and the console lines were dropped */
+    nu_assert_eq_int(lines, countLines(kFileLoggerName, "stalled message"));
+    logger_getStats(&stats);
+    nu_assert(stats.consoleDroppedLines > 0);
+
+    /* cleanup: let the writer fail, stop it and restore original stdout */
+    close(fds[0]);
+    logger_initConsoleLogger(stdout);
+    dup2(stdoutfd, 1);
+    close(fds[1]);
+    close(stdoutfd);
+    return 0;
+}
+
+static int test_consoleInterval(void)
+{
+    int stdoutfd;
+    int fds[2];
+    struct pollfd pfd;
+    char line[256];
+    ssize_t len;
+
+    /* setup: redirect stdout to a pipe */
+    fflush(stdout);
+    stdoutfd = dup(1);
+    if (pipe(fds) != 0) {
+        nu_fail();
+    }
+    dup2(fds[1], 1);
+    nu_assert(logger_initConsoleLoggerEx(stdout, LogConsoleOption_ASYNC));
+    poll(NULL, 0, 200); /* let the writer wait for lines */
+
+    /* when: log one line far smaller than a batch, without flushing */
+    LOG_INFO("interval message");
+
+    /* then: the line reaches the reader after the batch interval */
+    pfd.fd = fds[0];
+    pfd.events = POLLIN;
+    nu_assert_eq_int(1, poll(&pfd, 1, 1000));
+    nu_assert((len = read(fds[0], line, sizeof(line) - 1)) > 0);
+    line[len] = '\0';
+    nu_assert(strstr(line, "interval message") != NULL);
+
+    /* cleanup: stop the writer and restore original stdout */
+    logger_initConsoleLogger(stdout);
+    dup2(stdoutfd, 1);
+    close(fds[0]);
+    close(fds[1]);
+    close(stdoutfd);
+    return 0;
+}
+#endif /* !defined(_WIN32) && !defined(_WIN64) */
+
 int main(int argc, char* argv[])
 {
     setup();
     nu_run_test(test_consoleLogger);
+#if !defined(_WIN32) && !defined(_WIN64)
+    nu_run_test(test_asyncConsoleLogger);
+    nu_run_test(test_stalledConsole);
+    nu_run_test(test_consoleInterval);
+#endif /* !defined(_WIN32) && !defined(_WIN64) */
     cleanup();
     nu_report();
 }
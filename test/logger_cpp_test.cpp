@@ -0,0 +1,195 @@
+#include "logger.hpp"
+#include <cstdio>
+#include <string>
+#include "nanounit.h"
+
+using logger::detail::checkFormat;
+using logger::detail::TypeList;
+
+static const char kOutputFileName[] = "cpp.log";
+
+struct Point {
+    int x, y;
+};
+
+static logger::Stream& operator<<(logger::Stream& stream, const Point& p)
+{
+    return stream << '(' << p.x << ", " << p.y << ')';
+}
+
+/* compile-time format checking */
+static_assert(checkFormat("%d %s %f %p %%", TypeList<long, std::string, float, void*>()), "");
+static_assert(checkFormat("%5.2lf %-3c %llu %#x", TypeList<double, char, unsigned, short>()), "");
+static_assert(checkFormat("%s", TypeList<Point>()), "");
+static_assert(!checkFormat("%d", TypeList<const char*>()), "");
+static_assert(!checkFormat("%s", TypeList<int>()), "");
+static_assert(!checkFormat("%f", TypeList<int>()), "");
+static_assert(!checkFormat("%d %d", TypeList<int>()), "");
+static_assert(!checkFormat("%d", TypeList<int, int>()), "");
+static_assert(!checkFormat("%*d", TypeList<int, int>()), "");
+
+static void setup(void)
+{
+    remove(kOutputFileName);
+}
+
+static void cleanup(void)
+{
+    remove(kOutputFileName);
+}
+
+/* Read the messages of the file without their prefixes */
+static int readMessages(std::string* messages, int n)
+{
+    FILE* fp;
+    char line[512];
+    char* message;
+    int count = 0;
+
+    if ((fp = fopen(kOutputFileName, "r")) == NULL) {
+        return 0;
+    }
+    while (count < n && fgets(line, sizeof(line), fp) != NULL) {
+        line[strlen(line) - 1] = '\0'; /* remove LF */
+        if ((message = strstr(line, ".cpp:")) != NULL && (message = strstr(message, ": ")) != NULL) {
+            messages[count++] = message + 2;
+        }
+    }
+    fclose(fp);
+    return count;
+}
+
+static int test_sameOutputAsC(void)
+{
+    std::string messages[4];
+    const char* nullstr = NULL;
+
+    /* setup: */
+    remove(kOutputFileName);
+    logger_initFileLogger(kOutputFileName, 0, 0);
+
+    /* when: log the same formats through the C and C++ paths */
+    LOG_INFO("%d|%5d|%-4i|%u|%x|%X|%o|%c|%ld", -12, 34, 5, 6u, 255, 255, 8, 'z', 1234567890L);
+    LOGGER_INFO("%d|%5d|%-4i|%u|%x|%X|%o|%c|%ld", -12, 34, 5, 6u, 255, 255, 8, 'z', 1234567890L);
+    LOG_INFO("%s|%10s|%.2s|%f|%.3e|%g|%%|%s", "abc", "right", "xyz", 3.5, 1234.5, 0.25, nullstr);
+    LOGGER_INFO("%s|%10s|%.2s|%f|%.3e|%g|%%|%s", "abc", "right", "xyz", 3.5, 1234.5, 0.25, nullstr);
+    logger_flush();
+
+    /* then: the messages are identical */
+    nu_assert_eq_int(4, readMessages(messages, 4));
+    nu_assert_eq_str(messages[0].c_str(), messages[1].c_str());
+    nu_assert_eq_str(messages[2].c_str(), messages[3].c_str());
+    return 0;
+}
+
+static int test_typeSafety(void)
+{
+    std::string messages[3];
+    const std::string name = "widget";
+    const Point point = { 1, 2 };
+    long long big = 9007199254740993LL;
+
+    /* setup: */
+    remove(kOutputFileName);
+    logger_initFileLogger(kOutputFileName, 0, 0);
+
+    /* when: log C++ types */
+    LOGGER_INFO("%s at %s", name, point);
+    LOGGER_INFO("%d", big);
+    LOGGER_STREAM(LogLevel_INFO) << name << ' ' << point << ' ' << 42 << ' ' << 1.5;
+    logger_flush();
+
+    /* then: they are rendered by their types */
+    nu_assert_eq_int(3, readMessages(messages, 3));
+    nu_assert_eq_str("widget at (1, 2)", messages[0].c_str());
+    nu_assert_eq_str("9007199254740993", messages[1].c_str());
+    nu_assert_eq_str("widget (1, 2) 42 1.5", messages[2].c_str());
+    return 0;
+}
+
+static int s_evaluations = 0;
+
+static int evaluate(void)
+{
+    return ++s_evaluations;
+}
+
+static int test_disabled(void)
+{
+    /* when: log disabled messages */
+    LOGGER_DEBUG("%d", evaluate());
+    LOGGER_STREAM(LogLevel_TRACE) << evaluate();
+
+    /* then: the arguments are not evaluated */
+    nu_assert_eq_int(0, s_evaluations);
+    return 0;
+}
+
+static int test_threadLevel(void)
+{
+    LogLevel level;
+
+    {
+        /* when: */
+        logger::ThreadLevel trace(LogLevel_TRACE);
+        LOGGER_STREAM(LogLevel_TRACE) << evaluate();
+
+        /* then: */
+        nu_assert_eq_int(1, s_evaluations);
+        {
+            logger::ThreadLevel debug(LogLevel_DEBUG);
+            nu_assert(!logger_isEnabled(LogLevel_TRACE));
+        }
+        nu_assert(logger_isEnabled(LogLevel_TRACE));
+    }
+
+    /* then: the override ends with the scope */
+    nu_assert(!logger_getThreadLevel(&level));
+    nu_assert(!logger_isEnabled(LogLevel_TRACE));
+    return 0;
+}
+
+/* LOG_* in an inline member function alongside the ones in the functions of this file */
+struct Conn {
+    void open() { LOG_INFO("open"); }
+};
+
+static void closeConn(void)
+{
+    LOG_INFO("close");
+}
+
+static int test_memberFunction(void)
+{
+    std::string messages[2];
+    Conn conn;
+
+    /* setup: */
+    remove(kOutputFileName);
+    logger_initFileLogger(kOutputFileName, 0, 0);
+
+    /* when: log from a member function and a free function */
+    conn.open();
+    closeConn();
+    logger_flush();
+
+    /* then: */
+    nu_assert_eq_int(2, readMessages(messages, 2));
+    nu_assert_eq_str("open", messages[0].c_str());
+    nu_assert_eq_str("close", messages[1].c_str());
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    setup();
+    logger_setLevel(LogLevel_INFO);
+    nu_run_test(test_sameOutputAsC);
+    nu_run_test(test_typeSafety);
+    nu_run_test(test_disabled);
+    nu_run_test(test_threadLevel);
+    nu_run_test(test_memberFunction);
+    logger_exitFileLogger();
+    cleanup();
+    nu_report();
+}
@@ -0,0 +1,108 @@
+#include "logger.h"
+#include <stdio.h>
+#include "nanounit.h"
+
+static const char kOutputFileName[] = "dedup.log";
+
+static void setup(void)
+{
+    remove(kOutputFileName);
+}
+
+static void cleanup(void)
+{
+    remove(kOutputFileName);
+}
+
+static int test_deduplicate(void)
+{
+    const char message[] = "retrying";
+    FILE* fp;
+    char line[256];
+    int i, count = 0;
+
+    /* setup: deduplicate the file logger */
+    logger_initFileLogger(kOutputFileName, 0, 0);
+    logger_deduplicate(LogSink_FILE);
+
+    /* when: output the same message repeatedly */
+    for (i = 0; i < 5; i++) {
+        LOG_INFO("%s", message);
+    }
+    /* and: output a different message */
+    LOG_INFO("done");
+    logger_flush();
+
+    /* then: the repeats are collapsed into one summary line */
+    if ((fp = fopen(kOutputFileName, "r")) == NULL) {
+        nu_fail();
+    }
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        line[strlen(line) - 1] = '\0'; /* remove LF */
+        nu_assert_eq_int('I', line[0]);
+        switch (count) {
+            case 0:
+                nu_assert_eq_str(message, &line[strlen(line) - strlen(message)]);
+                break;
+            case 1:
+                nu_assert(strstr(line, ": last message repeated 4 times (first "));
+                break;
+            case 2:
+                nu_assert_eq_str("done", &line[strlen(line) - 4]);
+                break;
+        }
+        count++;
+    }
+    nu_assert_eq_int(3, count);
+
+    /* cleanup: close resources */
+    fclose(fp);
+    logger_deduplicate(0);
+    return 0;
+}
+
+static int test_pendingRepeatsOnFlush(void)
+{
+    FILE* fp;
+    char line[256];
+    int i, count = 0;
+
+    /* setup: deduplicate the file logger */
+    remove(kOutputFileName);
+    logger_initFileLogger(kOutputFileName, 0, 0);
+    logger_deduplicate(LogSink_FILE);
+
+    /* when: output the same message repeatedly and flush */
+    for (i = 0; i < 3; i++) {
+        LOG_WARN("timeout");
+    }
+    logger_flush();
+
+    /* then: the pending repeats are reported */
+    if ((fp = fopen(kOutputFileName, "r")) == NULL) {
+        nu_fail();
+    }
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        nu_assert_eq_int('W', line[0]);
+        if (count == 1) {
+            nu_assert(strstr(line, ": last message repeated 2 times (first "));
+        }
+        count++;
+    }
+    nu_assert_eq_int(2, count);
+
+    /* cleanup: close resources */
+    fclose(fp);
+    logger_deduplicate(0);
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    setup();
+    nu_run_test(test_deduplicate);
+    nu_run_test(test_pendingRepeatsOnFlush);
+    logger_exitFileLogger();
+    cleanup();
+    nu_report();
+}
@@ -1,17 +1,25 @@
 #include "logger.h"
 #include <stdio.h>
+#include <time.h>
+#if !defined(_WIN32) && !defined(_WIN64)
+ #include <utime.h>
+#endif /* !defined(_WIN32) && !defined(_WIN64) */
 #include "nanounit.h"
 
 static const char kOutputFileName[] = "file.log";
 
+static const char kIndexFileName[] = "file.log.idx";
+
 static void setup(void)
 {
     remove(kOutputFileName);
+    remove(kIndexFileName);
 }
 
 static void cleanup(void)
 {
     remove(kOutputFileName);
+    remove(kIndexFileName);
 }
 
 static int test_initFailed(void)
@@ -63,11 +71,380 @@ static int test_fileLogger(void)
     return 0;
 }
 
+/* Count the lines of the output file and check that no padding is left in it */
+static int countLines(const char* message)
+{
+    FILE* fp;
+    char line[256];
+    int count = 0;
+
+    if ((fp = fopen(kOutputFileName, "r")) == NULL) {
+        return -1;
+    }
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if (line[strlen(line) - 1] != '\n' || strstr(line, message) == NULL) {
+            count = -1;
+            break;
+        }
+        count++;
+    }
+    fclose(fp);
+    return count;
+}
+
+static int test_preallocatedFile(void)
+{
+    const char message[] = "preallocated";
+    int i;
+
+    /* when: output to a preallocated file */
+    remove(kOutputFileName);
+    nu_assert_eq_int(1, logger_initFileLoggerEx(kOutputFileName, 0, 0, LogFileOption_PREALLOCATE));
+    for (i = 0; i < 100; i++) {
+        LOG_INFO("%s %d", message, i);
+    }
+    logger_exitFileLogger();
+
+    /* then: the file ends at the last line */
+    nu_assert_eq_int(100, countLines(message));
+    return 0;
+}
+
+static int test_directFile(void)
+{
+    const char message[] = "direct";
+    int i;
+
+    /* when: output to the file with O_DIRECT across flushes and reopening */
+    remove(kOutputFileName);
+    nu_assert_eq_int(1, logger_initFileLoggerEx(kOutputFileName, 0, 0,
+            LogFileOption_PREALLOCATE | LogFileOption_DIRECT));
+    for (i = 0; i < 10000; i++) {
+        LOG_INFO("%s %d", message, i);
+        if (i % 3000 == 0) {
+            logger_flush();
+        }
+    }
+    logger_exitFileLogger();
+    nu_assert_eq_int(1, logger_initFileLoggerEx(kOutputFileName, 0, 0, LogFileOption_DIRECT));
+    LOG_INFO("%s appended", message);
+    logger_exitFileLogger();
+
+    /* then: every line is written once without padding */
+    nu_assert_eq_int(10001, countLines(message));
+    return 0;
+}
+
+static int test_indexedFile(void)
+{
+    FILE* fp;
+    char data[65536];
+    char magic[8];
+    unsigned long long entry[2]; /* time, offset */
+    unsigned long long lastTime = 0, lastOffset = 0;
+    size_t size;
+    int i, count = 0;
+
+    /* when: output to the file with an index entry every 1 KB */
+    remove(kOutputFileName);
+    remove(kIndexFileName);
+    logger_indexFile(1024);
+    nu_assert_eq_int(1, logger_initFileLogger(kOutputFileName, 0, 0));
+    for (i = 0; i < 500; i++) {
+        LOG_INFO("indexed %d", i);
+    }
+    logger_exitFileLogger();
+    logger_indexFile(0);
+
+    /* then: the entries point to the starts of lines in order */
+    if ((fp = fopen(kOutputFileName, "rb")) == NULL) {
+        nu_fail();
+    }
+    size = fread(data, 1, sizeof(data), fp);
+    fclose(fp);
+    if ((fp = fopen(kIndexFileName, "rb")) == NULL) {
+        nu_fail();
+    }
+    nu_assert_eq_int(8, (int) fread(magic, 1, sizeof(magic), fp));
+    nu_assert(memcmp(magic, "LOGIDX01", sizeof(magic)) == 0);
+    while (fread(entry, sizeof(entry), 1, fp) == 1) {
+        nu_assert(entry[0] >= lastTime);
+        nu_assert(count == 0 || entry[1] >= lastOffset + 1024);
+        nu_assert(entry[1] < size && (entry[1] == 0 || data[entry[1] - 1] == '\n'));
+        lastTime = entry[0];
+        lastOffset = entry[1];
+        count++;
+    }
+    fclose(fp);
+    nu_assert(count >= (int) (size / 1024) - 1 && count <= (int) (size / 1024) + 1);
+    return 0;
+}
+
+static int test_adaptiveFile(void)
+{
+    const char message[] = "adaptive";
+    LogStats stats;
+    time_t deadline;
+    int i;
+
+    /* when: log one line while idle */
+    remove(kOutputFileName);
+    nu_assert_eq_int(1, logger_initFileLoggerEx(kOutputFileName, 0, 0, LogFileOption_ADAPTIVE));
+    LOG_INFO("%s idle", message);
+
+    /* then: it is written at once */
+    nu_assert_eq_int(1, countLines(message));
+
+    /* when: log a burst */
+    for (i = 0; i < 20000; i++) {
+        LOG_INFO("%s %d", message, i);
+    }
+    logger_getStats(&stats);
+
+    /* then: the lines are batched */
+    nu_assert(stats.fileBatchSize > 0);
+#if !defined(_WIN32) && !defined(_WIN64)
+    /* and: the last batch is written shortly without a flush */
+    deadline = time(NULL) + 2;
+    while (countLines(message) != 20001 && time(NULL) <= deadline) {
+    }
+    nu_assert_eq_int(20001, countLines(message));
+#endif /* !defined(_WIN32) && !defined(_WIN64) */
+    logger_exitFileLogger();
+    nu_assert_eq_int(20001, countLines(message));
+    return 0;
+}
+
+static int test_flushLevel(void)
+{
+    const char message[] = "flushLevel";
+    int i;
+
+    /* given: a burst of lines being batched */
+    remove(kOutputFileName);
+    nu_assert_eq_int(1, logger_initFileLoggerEx(kOutputFileName, 0, 0, LogFileOption_ADAPTIVE));
+    logger_flushLevel(LogLevel_ERROR, 1);
+    for (i = 0; i < 1000; i++) {
+        LOG_INFO("%s %d", message, i);
+    }
+
+    /* when: */
+    LOG_ERROR("%s error", message);
+
+    /* then: the error is written at once with the batch */
+    nu_assert_eq_int(1001, countLines(message));
+    logger_flushLevel(LogLevel_ERROR, 0);
+    logger_exitFileLogger();
+    return 0;
+}
+
+static int test_syncFile(void)
+{
+    const char message[] = "syncFile";
+    LogStats stats;
+    unsigned long long syncs;
+    int i;
+
+    /* when: log with group commit */
+    remove(kOutputFileName);
+    nu_assert_eq_int(1, logger_initFileLoggerEx(kOutputFileName, 0, 0, LogFileOption_SYNC_GROUP));
+    logger_getStats(&stats);
+    syncs = stats.fileSyncs;
+    for (i = 0; i < 10; i++) {
+        LOG_INFO("%s %d", message, i);
+    }
+    logger_getStats(&stats);
+
+    /* then: every line is synced before the call returns */
+    nu_assert_eq_int(10, countLines(message));
+    nu_assert_eq_int(10, (int) (stats.fileSyncs - syncs));
+    logger_exitFileLogger();
+
+    /* when: log with periodic sync */
+    remove(kOutputFileName);
+    nu_assert_eq_int(1, logger_initFileLoggerEx(kOutputFileName, 0, 0, LogFileOption_SYNC_PERIODIC));
+    logger_getStats(&stats);
+    syncs = stats.fileSyncs;
+    for (i = 0; i < 10; i++) {
+        LOG_INFO("%s %d", message, i);
+    }
+    logger_flush();
+    logger_getStats(&stats);
+
+    /* then: the file is synced at the first line and at the flush */
+    nu_assert_eq_int(10, countLines(message));
+    nu_assert_eq_int(2, (int) (stats.fileSyncs - syncs));
+    logger_exitFileLogger();
+
+    /* when: log with group commit to a file written with O_DIRECT */
+    remove(kOutputFileName);
+    nu_assert_eq_int(1, logger_initFileLoggerEx(kOutputFileName, 0, 0,
+            LogFileOption_DIRECT | LogFileOption_SYNC_GROUP));
+    logger_getStats(&stats);
+    syncs = stats.fileSyncs;
+    for (i = 0; i < 10; i++) {
+        LOG_INFO("%s %d", message, i);
+    }
+    logger_getStats(&stats);
+
+    /* then: the file is synced all the same */
+    nu_assert_eq_int(10, (int) (stats.fileSyncs - syncs));
+    logger_exitFileLogger();
+    nu_assert_eq_int(10, countLines(message));
+    return 0;
+}
+
+#if !defined(_WIN32) && !defined(_WIN64)
+/* Read the level characters of the lines of the output file */
+static int readLevels(char* levels, size_t size)
+{
+    FILE* fp;
+    char line[256];
+    size_t n = 0;
+
+    if ((fp = fopen(kOutputFileName, "r")) == NULL) {
+        return 0;
+    }
+    while (n < size - 1 && fgets(line, sizeof(line), fp) != NULL) {
+        levels[n++] = line[0];
+    }
+    levels[n] = '\0';
+    fclose(fp);
+    return 1;
+}
+
+static int test_keepContext(void)
+{
+    char levels[64];
+    int i;
+
+    /* given: the DEBUG lines kept for an error */
+    remove(kOutputFileName);
+    nu_assert_eq_int(1, logger_initFileLogger(kOutputFileName, 0, 0));
+    nu_assert_eq_int(1, logger_keepContext(LogLevel_DEBUG, 4096));
+    nu_assert_eq_int(LogLevel_DEBUG, logger_enabledLevel);
+
+    /* when: log below and at the level */
+    LOG_TRACE("dropped");
+    LOG_DEBUG("kept %d", 1);
+    LOG_DEBUG("kept %d", 2);
+    LOG_INFO("written");
+    logger_flush();
+
+    /* then: only the INFO line is written */
+    nu_assert(readLevels(levels, sizeof(levels)));
+    nu_assert_eq_str("I", levels);
+
+    /* when: log an error */
+    LOG_ERROR("failed");
+    logger_flush();
+
+    /* then: the kept lines are written in order before it */
+    nu_assert(readLevels(levels, sizeof(levels)));
+    nu_assert_eq_str("IDDE", levels);
+
+    /* when: keep more lines than fit and dump them */
+    remove(kOutputFileName);
+    nu_assert_eq_int(1, logger_initFileLogger(kOutputFileName, 0, 0));
+    nu_assert_eq_int(1, logger_keepContext(LogLevel_DEBUG, 1024));
+    for (i = 0; i < 100; i++) {
+        LOG_DEBUG("kept %d", i);
+    }
+    logger_dumpContext();
+    logger_flush();
+
+    /* then: the newest lines are written */
+    nu_assert(readLevels(levels, sizeof(levels)));
+    nu_assert(strlen(levels) > 0 && strlen(levels) < 100);
+    nu_assert_eq_int((int) strlen(levels), countLines("kept"));
+
+    /* cleanup: stop keeping */
+    nu_assert_eq_int(1, logger_keepContext(LogLevel_DEBUG, 0));
+    nu_assert_eq_int(LogLevel_INFO, logger_enabledLevel);
+    logger_exitFileLogger();
+    return 0;
+}
+
+static int isFileExist(const char* filename)
+{
+    FILE* fp;
+
+    if ((fp = fopen(filename, "r")) == NULL) {
+        return 0;
+    }
+    fclose(fp);
+    return 1;
+}
+
+/* Wait for the retention thread to remove a file */
+static int waitRemoved(const char* filename)
+{
+    time_t deadline = time(NULL) + 2;
+
+    while (isFileExist(filename) && time(NULL) <= deadline) {
+    }
+    return !isFileExist(filename);
+}
+
+static int test_retainFiles(void)
+{
+    char name[64];
+    struct utimbuf old;
+    int i;
+
+    /* given: 10 backups of about 1 KB */
+    for (i = 0; i <= 10; i++) {
+        sprintf(name, "%s.%d", kOutputFileName, i);
+        remove(name);
+    }
+    remove(kOutputFileName);
+    nu_assert_eq_int(1, logger_initFileLogger(kOutputFileName, 1024, 10));
+    for (i = 0; i < 11 * 1024 / 64; i++) {
+        LOG_INFO("%s", "0123456789abcdef0123456789abcdef");
+    }
+
+    /* when: keep 5 KB of backups */
+    nu_assert_eq_int(1, logger_retainFiles(5 * 1024, 0));
+
+    /* then: the oldest backups are removed */
+    nu_assert(waitRemoved("file.log.10"));
+    nu_assert(waitRemoved("file.log.5"));
+    nu_assert(isFileExist("file.log.4"));
+
+    /* when: the oldest backup left is past the age */
+    old.actime = old.modtime = time(NULL) - 3600;
+    nu_assert_eq_int(0, utime("file.log.4", &old));
+    nu_assert_eq_int(1, logger_retainFiles(5 * 1024, 60));
+
+    /* then: it is removed */
+    nu_assert(waitRemoved("file.log.4"));
+    nu_assert(isFileExist("file.log.3"));
+
+    nu_assert_eq_int(1, logger_retainFiles(0, 0));
+    logger_exitFileLogger();
+    for (i = 0; i <= 10; i++) {
+        sprintf(name, "%s.%d", kOutputFileName, i);
+        remove(name);
+    }
+    return 0;
+}
+#endif /* !defined(_WIN32) && !defined(_WIN64) */
+
 int main(int argc, char* argv[])
 {
     setup();
     nu_run_test(test_initFailed);
     nu_run_test(test_fileLogger);
+    nu_run_test(test_preallocatedFile);
+    nu_run_test(test_directFile);
+    nu_run_test(test_indexedFile);
+    nu_run_test(test_adaptiveFile);
+    nu_run_test(test_flushLevel);
+    nu_run_test(test_syncFile);
+#if !defined(_WIN32) && !defined(_WIN64)
+    nu_run_test(test_keepContext);
+    nu_run_test(test_retainFiles);
+#endif /* !defined(_WIN32) && !defined(_WIN64) */
     cleanup();
     nu_report();
 }
@@ -0,0 +1,256 @@
+#include "logger.h"
+#include <stdio.h>
+#include <string.h>
+#include "nanounit.h"
+
+static const char kOutputFileName[] = "format.log";
+
+static void cleanup(void)
+{
+    remove(kOutputFileName);
+}
+
+/* Log one message with the format and read the line back without LF */
+static int logLine(const char* format, char* line, size_t size)
+{
+    FILE* fp;
+    int ok;
+
+    remove(kOutputFileName);
+    if (!logger_initFileLogger(kOutputFileName, 0, 0) || !logger_setFormat(format)) {
+        return 0;
+    }
+    LOG_WARN("message");
+    logger_exitFileLogger();
+    if ((fp = fopen(kOutputFileName, "r")) == NULL) {
+        return 0;
+    }
+    ok = fgets(line, size, fp) != NULL;
+    fclose(fp);
+    line[strlen(line) - 1] = '\0'; /* remove LF */
+    return ok;
+}
+
+static int test_defaultFormat(void)
+{
+    char line[256];
+    char date[32], file[64], message[32];
+    char level;
+    long threadID;
+    int lineno;
+
+    /* when: log with the default format */
+    nu_assert(logLine("%L %D %t %f:%l: %m", line, sizeof(line)));
+
+    /* then: the line keeps the original layout */
+    nu_assert_eq_int(7, sscanf(line, "%c %8s %15s %ld %63[^:]:%d: %31s",
+            &level, date, &date[9], &threadID, file, &lineno, message));
+    nu_assert_eq_int('W', level);
+    nu_assert_eq_int(15, (int) strlen(&date[9]));
+    nu_assert_eq_str("message", message);
+    return 0;
+}
+
+static int test_customFormat(void)
+{
+    char line[256];
+
+    /* when: log with fields after the message and without the time */
+    nu_assert(logLine("%V [%l] %m (%f) 100%%", line, sizeof(line)));
+
+    /* then: the fields are rendered around the message */
+    nu_assert(strncmp(line, "WARN [", 6) == 0);
+    nu_assert(strstr(line, "] message (") != NULL);
+    nu_assert_eq_str("logger_format_test.c) 100%", &line[strlen(line) - 26]);
+    return 0;
+}
+
+static int test_dateFormats(void)
+{
+    char line[256];
+
+    /* when: log with an ISO 8601 local time */
+    nu_assert(logLine("%D{iso8601} %m", line, sizeof(line)));
+
+    /* then: yyyy-MM-ddThh:mm:ss.uuuuuu+hh:mm */
+    nu_assert_eq_int('T', line[10]);
+    nu_assert_eq_int('.', line[19]);
+    nu_assert(line[26] == '+' || line[26] == '-');
+    nu_assert_eq_str(" message", &line[32]);
+
+    /* when: log with a UTC time */
+    nu_assert(logLine("%D{utc} %m", line, sizeof(line)));
+
+    /* then: yyyy-MM-ddThh:mm:ss.uuuuuuZ */
+    nu_assert_eq_int('T', line[10]);
+    nu_assert_eq_str("Z message", &line[26]);
+    return 0;
+}
+
+static int test_context(void)
+{
+    char line[256];
+
+    /* setup: */
+    nu_assert(logger_pushContext("req", "42"));
+    nu_assert(logger_pushContext("tenant", "acme"));
+
+    /* when: log with the default format */
+    nu_assert(logLine("%L %D %t %f:%l: %m", line, sizeof(line)));
+
+    /* then: the context precedes the message */
+    nu_assert(strstr(line, ": req=42 tenant=acme message") != NULL);
+
+    /* when: log with the default prefix and the context placed by the format */
+    nu_assert(logLine("%L %D %t %f:%l: <%X> %m", line, sizeof(line)));
+
+    /* then: the context is shown once */
+    nu_assert(strstr(line, ": <req=42 tenant=acme> message") != NULL);
+    nu_assert(strstr(line, ": req=42") == NULL);
+
+    /* when: log with the context in a custom format after a pop */
+    logger_popContext();
+    nu_assert(logLine("[%X] %m", line, sizeof(line)));
+
+    /* then: */
+    nu_assert_eq_str("[req=42] message", line);
+
+    /* when: log with an empty context */
+    logger_popContext();
+    nu_assert(logLine("%L %D %t %f:%l: %m", line, sizeof(line)));
+
+    /* then: the line has no context */
+    nu_assert(strstr(line, ": message") != NULL);
+    return 0;
+}
+
+/* Log the message with control characters escaped and read it back */
+static int logSanitized(const char* message, char* line, size_t size)
+{
+    FILE* fp;
+    int ok;
+
+    remove(kOutputFileName);
+    if (!logger_initFileLogger(kOutputFileName, 0, 0) || !logger_setFormat("%m")) {
+        return 0;
+    }
+    logger_sanitize(1);
+    LOG_WARN("%s", message);
+    logger_sanitize(0);
+    logger_exitFileLogger();
+    if ((fp = fopen(kOutputFileName, "r")) == NULL) {
+        return 0;
+    }
+    ok = fgets(line, size, fp) != NULL && fgetc(fp) == EOF;
+    fclose(fp);
+    line[strlen(line) - 1] = '\0'; /* remove LF */
+    return ok;
+}
+
+static int test_sanitize(void)
+{
+    char message[80], expected[96], line[256];
+    int i;
+
+    /* when: log control characters and UTF-8 */
+    nu_assert(logSanitized("a\nI forged\r\tb\033[2J\x7f \xc3\xa9", line, sizeof(line)));
+
+    /* then: they are escaped on one line, and UTF-8 is kept */
+    nu_assert_eq_str("a\\nI forged\\r\\tb\\x1b[2J\\x7f \xc3\xa9", line);
+
+    /* when: log a control character at every position of the vector scan */
+    for (i = 0; i < 70; i++) {
+        memset(message, 'x', 70);
+        message[70] = '\0';
+        message[i] = '\n';
+        nu_assert(logSanitized(message, line, sizeof(line)));
+
+        /* then: */
+        memset(expected, 'x', 71);
+        expected[71] = '\0';
+        expected[i] = '\\';
+        expected[i + 1] = 'n';
+        nu_assert_eq_str(expected, line);
+    }
+    return 0;
+}
+
+static int s_evaluations = 0;
+
+static const char* evaluate(void)
+{
+    s_evaluations++;
+    return "";
+}
+
+static int test_hexDump(void)
+{
+    char data[5000];
+    char line[256];
+    FILE* fp;
+    int rows = 0;
+
+    /* setup: */
+    memcpy(data, "Hello, world!\n\0\x80\xff", 17);
+    remove(kOutputFileName);
+    nu_assert(logger_initFileLogger(kOutputFileName, 0, 0));
+    nu_assert(logger_setFormat("%m"));
+    logger_setLevel(LogLevel_INFO);
+
+    /* when: dump at a disabled level */
+    LOG_HEX(LogLevel_DEBUG, evaluate(), 1);
+
+    /* then: the arguments are not evaluated */
+    nu_assert_eq_int(0, s_evaluations);
+
+    /* when: dump 17 bytes, more than the cap and none */
+    LOG_HEX(LogLevel_INFO, data, 17);
+    LOG_HEX(LogLevel_INFO, data, sizeof(data));
+    LOG_HEX(LogLevel_INFO, data, 0);
+    logger_exitFileLogger();
+
+    /* then: */
+    if ((fp = fopen(kOutputFileName, "r")) == NULL) {
+        nu_fail();
+    }
+    nu_assert(fgets(line, sizeof(line), fp) != NULL);
+    nu_assert_eq_str("0000  48 65 6c 6c 6f 2c 20 77  6f 72 6c 64 21 0a 00 80  |Hello, world!...|\n", line);
+    nu_assert(fgets(line, sizeof(line), fp) != NULL);
+    nu_assert_eq_str("0010  ff                                                |.|\n", line);
+    while (fgets(line, sizeof(line), fp) != NULL && line[0] != '(') {
+        rows++;
+    }
+    nu_assert_eq_int(256, rows);
+    nu_assert_eq_str("(904 bytes not dumped)\n", line);
+    nu_assert(fgets(line, sizeof(line), fp) != NULL);
+    nu_assert_eq_str("(0 bytes)\n", line);
+    nu_assert(fgets(line, sizeof(line), fp) == NULL);
+    fclose(fp);
+    return 0;
+}
+
+static int test_invalidFormat(void)
+{
+    /* when: set formats without exactly one message or with unknown fields */
+    /* then: failed */
+    nu_assert_eq_int(0, logger_setFormat("%L %D"));
+    nu_assert_eq_int(0, logger_setFormat("%m %m"));
+    nu_assert_eq_int(0, logger_setFormat("%x %m"));
+    nu_assert_eq_int(0, logger_setFormat("%D{local} %m"));
+    nu_assert_eq_int(0, logger_setFormat("%m %"));
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    nu_run_test(test_defaultFormat);
+    nu_run_test(test_customFormat);
+    nu_run_test(test_dateFormats);
+    nu_run_test(test_context);
+    nu_run_test(test_sanitize);
+    nu_run_test(test_hexDump);
+    nu_run_test(test_invalidFormat);
+    logger_setFormat("%L %D %t %f:%l: %m");
+    cleanup();
+    nu_report();
+}
@@ -0,0 +1,114 @@
+#include "logger.h"
+#include <stdio.h>
+#include "nanounit.h"
+
+static const char kFirstFileName[] = "first.log";
+static const char kSecondFileName[] = "second.log";
+
+static void setup(void)
+{
+    remove(kFirstFileName);
+    remove(kSecondFileName);
+}
+
+static void cleanup(void)
+{
+    remove(kFirstFileName);
+    remove(kSecondFileName);
+}
+
+/* Count the lines of a file ending with the message */
+static int countLines(const char* filename, const char* message)
+{
+    FILE* fp;
+    char line[256];
+    int count = 0;
+
+    if ((fp = fopen(filename, "r")) == NULL) {
+        return -1;
+    }
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        line[strlen(line) - 1] = '\0'; /* remove LF */
+        if (strlen(line) >= strlen(message)
+                && strcmp(message, &line[strlen(line) - strlen(message)]) == 0) {
+            count++;
+        }
+    }
+    fclose(fp);
+    return count;
+}
+
+static int test_instances(void)
+{
+    const char message[] = "message";
+    logger_t* first;
+    logger_t* second;
+
+    /* setup: two loggers writing to their own files */
+    first = logger_create();
+    second = logger_create();
+    nu_assert(first != NULL);
+    nu_assert(second != NULL);
+    nu_assert_eq_int(1, logger_addFile(first, kFirstFileName, 0, 0, 0));
+    nu_assert_eq_int(1, logger_addFile(second, kSecondFileName, 0, 0, 0));
+
+    /* when: set different levels */
+    logger_setLoggerLevel(first, LogLevel_DEBUG);
+    logger_setLoggerLevel(second, LogLevel_WARN);
+
+    /* then: the levels are their own, and the default level is left alone */
+    nu_assert_eq_int(LogLevel_DEBUG, logger_getLoggerLevel(first));
+    nu_assert_eq_int(LogLevel_WARN, logger_getLoggerLevel(second));
+    nu_assert_eq_int(LogLevel_INFO, logger_getLevel());
+    nu_assert(logger_isLoggerEnabled(first, LogLevel_DEBUG));
+    nu_assert(!logger_isLoggerEnabled(second, LogLevel_INFO));
+
+    /* when: log to both at every level */
+    LOG_TRACE_TO(first, message);
+    LOG_DEBUG_TO(first, message);
+    LOG_WARN_TO(first, message);
+    LOG_DEBUG_TO(second, message);
+    LOG_INFO_TO(second, message);
+    LOG_WARN_TO(second, message);
+    LOG_ERROR_TO(second, message);
+    logger_flushLogger(first);
+    logger_flushLogger(second);
+
+    /* then: each file has the lines of its logger only */
+    nu_assert_eq_int(2, countLines(kFirstFileName, message));
+    nu_assert_eq_int(2, countLines(kSecondFileName, message));
+
+    /* cleanup: destroy the loggers */
+    logger_destroy(first);
+    logger_destroy(second);
+    return 0;
+}
+
+static int test_destroy(void)
+{
+    const char message[] = "destroyed";
+    logger_t* logger;
+
+    /* setup: a logger with a line left in the buffer */
+    remove(kFirstFileName);
+    logger = logger_create();
+    nu_assert(logger != NULL);
+    nu_assert_eq_int(1, logger_addFile(logger, kFirstFileName, 0, 0, 0));
+    LOG_INFO_TO(logger, message);
+
+    /* when: destroy the logger */
+    logger_destroy(logger);
+
+    /* then: the line has been written */
+    nu_assert_eq_int(1, countLines(kFirstFileName, message));
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    setup();
+    nu_run_test(test_instances);
+    nu_run_test(test_destroy);
+    cleanup();
+    nu_report();
+}
@@ -98,6 +98,76 @@ static int test_fatal(void)
     return 0;
 }
 
+static int s_evaluations = 0;
+
+static const char* evaluate(void)
+{
+    s_evaluations++;
+    return "argument";
+}
+
+static int test_lazyArguments(void)
+{
+    const char filename[] = "loglevel.log";
+
+    /* setup: */
+    logger_initFileLogger(filename, 0, 0);
+    logger_setLevel(LogLevel_INFO);
+
+    /* when: log disabled messages */
+    LOG_TRACE("%s", evaluate());
+    LOG_DEBUG("%s", evaluate());
+
+    /* then: the arguments are not evaluated */
+    nu_assert_eq_int(0, s_evaluations);
+
+    /* when: log an enabled message */
+    LOG_INFO("%s", evaluate());
+
+    /* then: the argument is evaluated once */
+    nu_assert_eq_int(1, s_evaluations);
+
+    /* cleanup: */
+    logger_exitFileLogger();
+    remove(filename);
+    return 0;
+}
+
+static int test_threadLevel(void)
+{
+    LogLevel level;
+
+    /* setup: */
+    logger_setLevel(LogLevel_INFO);
+
+    /* when: */
+    logger_setThreadLevel(LogLevel_TRACE);
+
+    /* then: this thread logs at its own level */
+    nu_assert(logger_getThreadLevel(&level));
+    nu_assert_eq_int(LogLevel_TRACE, level);
+    nu_assert_eq_int(LogLevel_INFO, logger_getLevel());
+    nu_assert(logger_isEnabled(LogLevel_TRACE));
+    nu_assert_eq_int(LogLevel_TRACE, logger_enabledLevel);
+
+    /* when: */
+    logger_setThreadLevel(LogLevel_ERROR);
+
+    /* then: */
+    nu_assert(!logger_isEnabled(LogLevel_WARN));
+    nu_assert_eq_int(LogLevel_INFO, logger_enabledLevel);
+
+    /* when: */
+    logger_clearThreadLevel();
+
+    /* then: this thread follows the logger again */
+    nu_assert(!logger_getThreadLevel(&level));
+    nu_assert(!logger_isEnabled(LogLevel_DEBUG));
+    nu_assert(logger_isEnabled(LogLevel_WARN));
+    nu_assert_eq_int(LogLevel_INFO, logger_enabledLevel);
+    return 0;
+}
+
 int main(int argc, char* argv[])
 {
     nu_run_test(test_trace);
@@ -106,5 +176,7 @@ int main(int argc, char* argv[])
     nu_run_test(test_warn);
     nu_run_test(test_error);
     nu_run_test(test_fatal);
+    nu_run_test(test_lazyArguments);
+    nu_run_test(test_threadLevel);
     nu_report();
 }
@@ -0,0 +1,138 @@
+#include "logger.h"
+#include <dirent.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "nanounit.h"
+
+static const char kOutputFileName[] = "perthread.log";
+static const char kThreadFilePrefix[] = "perthread.log.t";
+enum {
+    kThreads = 4,
+    kLinesPerThread = 2000,
+};
+
+/* Call a function with the name of every file of the threads */
+static int forEachThreadFile(int (*func)(const char* filename))
+{
+    DIR* dir;
+    struct dirent* entry;
+    int result = 0;
+
+    if ((dir = opendir(".")) == NULL) {
+        return -1;
+    }
+    while ((entry = readdir(dir)) != NULL) {
+        if (strncmp(entry->d_name, kThreadFilePrefix, strlen(kThreadFilePrefix)) == 0) {
+            if (func(entry->d_name) != 0) {
+                result = -1;
+            }
+        }
+    }
+    closedir(dir);
+    return result;
+}
+
+static int removeFile(const char* filename)
+{
+    return remove(filename);
+}
+
+static int seen[kThreads][kLinesPerThread];
+
+/* Count the lines of a file and check that they come from the thread owning it */
+static int countLines(const char* filename)
+{
+    FILE* fp;
+    char line[256];
+    long threadID, fileThreadID;
+    int worker, index;
+    char* p;
+
+    fileThreadID = atol(&filename[strlen(kThreadFilePrefix)]);
+    if ((fp = fopen(filename, "r")) == NULL) {
+        return -1;
+    }
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if (sscanf(&line[27], "%ld", &threadID) != 1 || threadID != fileThreadID
+                || (p = strstr(line, ": worker=")) == NULL
+                || sscanf(p, ": worker=%d line=%d", &worker, &index) != 2) {
+            fclose(fp);
+            return -1;
+        }
+        seen[worker][index]++;
+    }
+    fclose(fp);
+    return 0;
+}
+
+static void* runWorker(void* arg)
+{
+    int worker = *(int*) arg;
+    int i;
+
+    for (i = 0; i < kLinesPerThread; i++) {
+        LOG_INFO("worker=%d line=%d", worker, i);
+    }
+    return NULL;
+}
+
+static int test_perThreadFileLogger(void)
+{
+    pthread_t threads[kThreads];
+    int workers[kThreads];
+    int i, j;
+
+    /* when: several threads log to their own files */
+    nu_assert_eq_int(1, logger_initFileLoggerEx(kOutputFileName, 16384, 20,
+            LogFileOption_PER_THREAD));
+    for (i = 0; i < kThreads; i++) {
+        workers[i] = i;
+        pthread_create(&threads[i], NULL, runWorker, &workers[i]);
+    }
+    for (i = 0; i < kThreads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    /* then: every line is written once to the file of its thread */
+    memset(seen, 0, sizeof(seen));
+    nu_assert_eq_int(0, forEachThreadFile(countLines));
+    for (i = 0; i < kThreads; i++) {
+        for (j = 0; j < kLinesPerThread; j++) {
+            nu_assert_eq_int(1, seen[i][j]);
+        }
+    }
+    return 0;
+}
+
+static void* runTracer(void* arg)
+{
+    logger_setThreadLevel(LogLevel_TRACE);
+    LOG_TRACE("tracing");
+    return NULL;
+}
+
+static int test_threadLevelAtExit(void)
+{
+    pthread_t thread;
+
+    /* when: a thread exits without clearing its level */
+    logger_setLevel(LogLevel_INFO);
+    pthread_create(&thread, NULL, runTracer, NULL);
+    pthread_join(thread, NULL);
+
+    /* then: the level is cleared with the thread */
+    nu_assert_eq_int(LogLevel_INFO, logger_enabledLevel);
+    nu_assert(!logger_isEnabled(LogLevel_DEBUG));
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    forEachThreadFile(removeFile);
+    nu_run_test(test_perThreadFileLogger);
+    nu_run_test(test_threadLevelAtExit);
+    forEachThreadFile(removeFile);
+    nu_report();
+}
@@ -0,0 +1,118 @@
+#include "logger.h"
+#include <stdio.h>
+#include <string.h>
+#if !defined(_WIN32) && !defined(_WIN64)
+ #include <pthread.h>
+#endif /* !defined(_WIN32) && !defined(_WIN64) */
+#include "nanounit.h"
+
+static const char kOutputFileName[] = "profile.log";
+static const char kProfileFileName[] = "profile.txt";
+
+/* Get the number of lines timed in a stage of the dumped profile, or -1 if it is missing */
+static int getStageCount(const char* stage)
+{
+    FILE* fp;
+    char line[1024], name[16];
+    unsigned long count;
+    int result = -1;
+
+    if ((fp = fopen(kProfileFileName, "r")) == NULL) {
+        return -1;
+    }
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if (sscanf(line, "%15s %lu", name, &count) == 2 && strcmp(name, stage) == 0) {
+            result = (int) count;
+            break;
+        }
+    }
+    fclose(fp);
+    return result;
+}
+
+static int dumpProfile(void)
+{
+    FILE* fp;
+    int result;
+
+    if ((fp = fopen(kProfileFileName, "w")) == NULL) {
+        return 0;
+    }
+    result = logger_dumpProfile(fp);
+    fclose(fp);
+    return result;
+}
+
+#if !defined(_WIN32) && !defined(_WIN64)
+static void* runWorker(void* arg)
+{
+    int i;
+
+    for (i = 0; i < 100; i++) {
+        LOG_INFO("worker %d", i);
+    }
+    return NULL;
+}
+#endif /* !defined(_WIN32) && !defined(_WIN64) */
+
+static int test_dumpProfile(void)
+{
+    int i;
+
+    /* when: log lines */
+    remove(kOutputFileName);
+    nu_assert_eq_int(1, logger_initFileLogger(kOutputFileName, 0, 0));
+    for (i = 0; i < 100; i++) {
+        LOG_INFO("profile %d", i);
+    }
+    nu_assert_eq_int(1, dumpProfile());
+
+    /* then: every stage of every line is timed */
+    nu_assert_eq_int(100, getStageCount("clock"));
+    nu_assert_eq_int(100, getStageCount("thread"));
+    nu_assert_eq_int(100, getStageCount("prefix"));
+    nu_assert_eq_int(100, getStageCount("message"));
+    nu_assert_eq_int(100, getStageCount("lock"));
+    nu_assert_eq_int(100, getStageCount("rotate"));
+    nu_assert_eq_int(100, getStageCount("write"));
+    nu_assert_eq_int(100, getStageCount("flush"));
+    nu_assert_eq_int(-1, getStageCount("sync"));
+    nu_assert_eq_int(100, getStageCount("total"));
+    logger_exitFileLogger();
+    remove(kOutputFileName);
+    remove(kProfileFileName);
+    return 0;
+}
+
+#if !defined(_WIN32) && !defined(_WIN64)
+static int test_exitedThreadProfile(void)
+{
+    pthread_t worker;
+    int count;
+
+    /* when: a thread logs and exits */
+    remove(kOutputFileName);
+    nu_assert_eq_int(1, logger_initFileLogger(kOutputFileName, 0, 0));
+    nu_assert_eq_int(1, dumpProfile());
+    count = getStageCount("total");
+    pthread_create(&worker, NULL, runWorker, NULL);
+    pthread_join(worker, NULL);
+    nu_assert_eq_int(1, dumpProfile());
+
+    /* then: its lines are kept in the profile */
+    nu_assert_eq_int(count + 100, getStageCount("total"));
+    logger_exitFileLogger();
+    remove(kOutputFileName);
+    remove(kProfileFileName);
+    return 0;
+}
+#endif /* !defined(_WIN32) && !defined(_WIN64) */
+
+int main(int argc, char* argv[])
+{
+    nu_run_test(test_dumpProfile);
+#if !defined(_WIN32) && !defined(_WIN64)
+    nu_run_test(test_exitedThreadProfile);
+#endif /* !defined(_WIN32) && !defined(_WIN64) */
+    nu_report();
+}
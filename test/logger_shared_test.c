@@ -0,0 +1,160 @@
+#include "logger.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "nanounit.h"
+
+static const char kOutputFileName[] = "shared.log";
+static const char kLockFileName[] = "shared.log.lock";
+static const int kProcesses = 4;
+static const int kLinesPerProcess = 500;
+static const long kMaxFileSize = 8192;
+static const int kMaxBackupFiles = 100;
+
+static void removeFiles(void)
+{
+    char name[64];
+    int i;
+
+    remove(kOutputFileName);
+    remove(kLockFileName);
+    for (i = 1; i <= kMaxBackupFiles; i++) {
+        sprintf(name, "%s.%d", kOutputFileName, i);
+        remove(name);
+    }
+}
+
+static void runWorker(int worker)
+{
+    int i;
+
+    if (!logger_initFileLoggerEx(kOutputFileName, kMaxFileSize, kMaxBackupFiles, LogFileOption_SHARED)) {
+        exit(1);
+    }
+    for (i = 0; i < kLinesPerProcess; i++) {
+        LOG_INFO("worker=%d line=%d", worker, i);
+    }
+    logger_exitFileLogger();
+    exit(0);
+}
+
+/* Count the lines of one file and check that they are whole */
+static int countLines(const char* filename, int* seen, long* size)
+{
+    FILE* fp;
+    char line[256];
+    char* p;
+    int worker, index, count = 0;
+
+    *size = 0;
+    if ((fp = fopen(filename, "r")) == NULL) {
+        return 0;
+    }
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        *size += strlen(line);
+        if (line[0] != 'I' || line[strlen(line) - 1] != '\n'
+                || (p = strstr(line, ": worker=")) == NULL
+                || sscanf(p, ": worker=%d line=%d", &worker, &index) != 2) {
+            fclose(fp);
+            return -1;
+        }
+        seen[worker * kLinesPerProcess + index]++;
+        count++;
+    }
+    fclose(fp);
+    return count;
+}
+
+static int test_sharedFileLogger(void)
+{
+    int seen[4 * 500];
+    char name[64];
+    pid_t pids[4];
+    int i, status, n, total = 0;
+    long size;
+
+    /* when: several processes log to the same file */
+    for (i = 0; i < kProcesses; i++) {
+        if ((pids[i] = fork()) == 0) {
+            runWorker(i);
+        }
+    }
+    for (i = 0; i < kProcesses; i++) {
+        waitpid(pids[i], &status, 0);
+        nu_assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    }
+
+    /* then: every line is written exactly once, whole */
+    memset(seen, 0, sizeof(seen));
+    for (i = 0; i <= kMaxBackupFiles; i++) {
+        if (i == 0) {
+            strcpy(name, kOutputFileName);
+        } else {
+            sprintf(name, "%s.%d", kOutputFileName, i);
+        }
+        n = countLines(name, seen, &size);
+        nu_assert(n >= 0);
+        total += n;
+        /* and: the files are rotated once, not by every process */
+        nu_assert(size < kMaxFileSize + kProcesses * 256);
+    }
+    nu_assert_eq_int(kProcesses * kLinesPerProcess, total);
+    for (i = 0; i < kProcesses * kLinesPerProcess; i++) {
+        nu_assert_eq_int(1, seen[i]);
+    }
+    return 0;
+}
+
+static int test_rotationByTwoProcesses(void)
+{
+    int seen[4 * 500];
+    char name[64];
+    pid_t pids[2];
+    int i, status, n, backups = 0, total = 0;
+    long size;
+
+    /* when: two processes log to the same file across many rotations */
+    removeFiles();
+    for (i = 0; i < 2; i++) {
+        if ((pids[i] = fork()) == 0) {
+            runWorker(i);
+        }
+    }
+    for (i = 0; i < 2; i++) {
+        waitpid(pids[i], &status, 0);
+        nu_assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    }
+
+    /* then: every backup was rotated at the size counted by both processes */
+    memset(seen, 0, sizeof(seen));
+    for (i = 1; i <= kMaxBackupFiles; i++) {
+        sprintf(name, "%s.%d", kOutputFileName, i);
+        if ((n = countLines(name, seen, &size)) == 0) {
+            break;
+        }
+        nu_assert(n > 0);
+        nu_assert(size >= kMaxFileSize - 2 * 256);
+        nu_assert(size < kMaxFileSize + 2 * 256);
+        backups++;
+        total += n;
+    }
+    nu_assert(backups >= 2);
+    n = countLines(kOutputFileName, seen, &size);
+    nu_assert(n >= 0);
+    nu_assert_eq_int(2 * kLinesPerProcess, total + n);
+    for (i = 0; i < 2 * kLinesPerProcess; i++) {
+        nu_assert_eq_int(1, seen[i]);
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    removeFiles();
+    nu_run_test(test_sharedFileLogger);
+    nu_run_test(test_rotationByTwoProcesses);
+    removeFiles();
+    nu_report();
+}
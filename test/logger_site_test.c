@@ -0,0 +1,119 @@
+#include "logger.h"
+#include <stdio.h>
+#include "nanounit.h"
+
+static const char kOutputFileName[] = "site.log";
+
+static void setup(void)
+{
+    remove(kOutputFileName);
+}
+
+static void cleanup(void)
+{
+    remove(kOutputFileName);
+}
+
+static int countLines(void)
+{
+    FILE* fp;
+    char line[256];
+    int count = 0;
+
+    logger_flush();
+    if ((fp = fopen(kOutputFileName, "r")) == NULL) {
+        return -1;
+    }
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        count++;
+    }
+    fclose(fp);
+    return count;
+}
+
+static void logLines(void)
+{
+    LOG_DEBUG("site debug");
+    LOG_INFO("site info");
+}
+
+/* Find a site of this file by its format as written in the source */
+static LogSite* findSite(const char* format)
+{
+    LogSite* sites;
+    size_t i, n = logger_getSites(&sites);
+
+    for (i = 0; i < n; i++) {
+        if (strcmp(sites[i].format, format) == 0 && strstr(sites[i].file, "logger_site_test.c") != NULL) {
+            return &sites[i];
+        }
+    }
+    return NULL;
+}
+
+static int test_sites(void)
+{
+    LogSite* debug;
+    LogSite* info;
+    char pattern[64];
+
+    /* given: a file logger at INFO */
+    nu_assert_eq_int(1, logger_initFileLogger(kOutputFileName, 0, 0));
+    logLines();
+    nu_assert_eq_int(1, countLines());
+
+    /* when: find the sites */
+    debug = findSite("\"site debug\"");
+    info = findSite("\"site info\"");
+
+    /* then: they describe the calls, resolved at the level */
+    nu_assert(debug != NULL);
+    nu_assert(info != NULL);
+    nu_assert_eq_int(LogLevel_DEBUG, debug->level);
+    nu_assert_eq_int(info->line - 1, debug->line);
+    nu_assert_eq_int(LOGGER_SITE_OFF, debug->enabled);
+    nu_assert_eq_int(LOGGER_SITE_ON, info->enabled);
+
+    /* when: switch the DEBUG site on */
+    logger_setSite(debug, LogSite_ON);
+    logLines();
+
+    /* then: it logs below the level */
+    nu_assert_eq_int(LOGGER_SITE_ON, debug->enabled);
+    nu_assert_eq_int(3, countLines());
+
+    /* when: switch the sites of this file off */
+    nu_assert(logger_setSites("logger_site_*.c", LogSite_OFF) >= 2);
+    logLines();
+
+    /* then: nothing is logged */
+    nu_assert_eq_int(3, countLines());
+
+    /* when: make one line follow the level again */
+    sprintf(pattern, "logger_site_test.c:%d", info->line);
+    nu_assert_eq_int(1, logger_setSites(pattern, LogSite_DEFAULT));
+    logLines();
+
+    /* then: only it logs */
+    nu_assert_eq_int(4, countLines());
+
+    /* when: reset the sites and lower the level */
+    nu_assert(logger_setSites("*", LogSite_DEFAULT) >= 2);
+    logger_setLevel(LogLevel_DEBUG);
+
+    /* then: the flags follow the level */
+    nu_assert_eq_int(LOGGER_SITE_ON, debug->enabled);
+    logger_setLevel(LogLevel_INFO);
+    nu_assert_eq_int(LOGGER_SITE_OFF, debug->enabled);
+
+    logger_exitFileLogger();
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    setup();
+    nu_run_test(test_sites);
+    cleanup();
+    nu_report();
+}
@@ -0,0 +1,171 @@
+#include "logger.h"
+#include <stdio.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "nanounit.h"
+
+static const char kSocketPath[] = "socket.sock";
+
+static void setup(void)
+{
+    unlink(kSocketPath);
+}
+
+static void cleanup(void)
+{
+    unlink(kSocketPath);
+}
+
+static int openReceiver(int type)
+{
+    struct sockaddr_un addr;
+    int fd;
+
+    if ((fd = socket(AF_UNIX, type, 0)) < 0) {
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, kSocketPath, sizeof(addr.sun_path) - 1);
+    if (bind(fd, (struct sockaddr*) &addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    if (type == SOCK_STREAM && listen(fd, 1) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int countLines(const char* buf, const char* message)
+{
+    const char* p;
+    int count = 0;
+
+    for (p = buf; (p = strstr(p, message)) != NULL; p += strlen(message)) {
+        count++;
+    }
+    return count;
+}
+
+static int test_datagram(void)
+{
+    int receiver;
+    char buf[4096];
+    ssize_t size;
+    LogStats stats;
+
+    /* setup: start a collector */
+    if ((receiver = openReceiver(SOCK_DGRAM)) < 0) {
+        nu_fail();
+    }
+
+    /* when: initialize socket logger */
+    nu_assert_eq_int(1, logger_initSocketLogger(kSocketPath, LogSocket_DGRAM));
+
+    /* and: output to the socket */
+    LOG_DEBUG("message");
+    LOG_INFO("message");
+    LOG_WARN("message");
+    logger_flush();
+
+    /* then: the lines arrive in one datagram */
+    size = recv(receiver, buf, sizeof(buf) - 1, 0);
+    nu_assert(size > 0);
+    buf[size] = '\0';
+    nu_assert_eq_int('I', buf[0]);
+    nu_assert_eq_int('\n', buf[size - 1]);
+    nu_assert_eq_int(2, countLines(buf, ": message\n"));
+
+    /* and: the bytes are counted */
+    logger_getStats(&stats);
+    nu_assert(stats.socketSentBytes == (unsigned long long) size);
+
+    /* cleanup: close resources */
+    logger_exitSocketLogger();
+    close(receiver);
+    unlink(kSocketPath);
+    return 0;
+}
+
+static int test_reconnect(void)
+{
+    int receiver;
+    char buf[4096];
+    ssize_t size;
+
+    /* setup: initialize socket logger before the collector starts */
+    nu_assert_eq_int(1, logger_initSocketLogger(kSocketPath, LogSocket_DGRAM));
+
+    /* when: output while the collector is unreachable */
+    LOG_INFO("spilled");
+    logger_flush();
+
+    /* and: start the collector */
+    if ((receiver = openReceiver(SOCK_DGRAM)) < 0) {
+        nu_fail();
+    }
+    LOG_INFO("sent");
+    logger_flush();
+
+    /* then: the spilled line is delivered before the new one */
+    size = recv(receiver, buf, sizeof(buf) - 1, 0);
+    nu_assert(size > 0);
+    buf[size] = '\0';
+    nu_assert(strstr(buf, ": spilled\n"));
+    nu_assert(strstr(buf, ": sent\n"));
+    nu_assert(strstr(buf, ": spilled\n") < strstr(buf, ": sent\n"));
+
+    /* cleanup: close resources */
+    logger_exitSocketLogger();
+    close(receiver);
+    unlink(kSocketPath);
+    return 0;
+}
+
+static int test_stream(void)
+{
+    int receiver, conn;
+    char buf[4096];
+    ssize_t size;
+
+    /* setup: start a collector */
+    if ((receiver = openReceiver(SOCK_STREAM)) < 0) {
+        nu_fail();
+    }
+
+    /* when: output to the socket */
+    nu_assert_eq_int(1, logger_initSocketLogger(kSocketPath, LogSocket_STREAM));
+    LOG_INFO("message");
+    LOG_ERROR("message");
+    logger_flush();
+
+    /* then: the lines arrive on the connection */
+    if ((conn = accept(receiver, NULL, NULL)) < 0) {
+        close(receiver);
+        nu_fail();
+    }
+    size = recv(conn, buf, sizeof(buf) - 1, 0);
+    nu_assert(size > 0);
+    buf[size] = '\0';
+    nu_assert_eq_int(2, countLines(buf, ": message\n"));
+
+    /* cleanup: close resources */
+    logger_exitSocketLogger();
+    close(conn);
+    close(receiver);
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    setup();
+    logger_setLevel(LogLevel_INFO);
+    nu_run_test(test_datagram);
+    nu_run_test(test_reconnect);
+    nu_run_test(test_stream);
+    cleanup();
+    nu_report();
+}
@@ -0,0 +1,228 @@
+#define _POSIX_C_SOURCE 200112L /* clock_gettime() */
+#include "logger.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "nanounit.h"
+
+#if defined(__has_feature)
+ #if __has_feature(thread_sanitizer) || __has_feature(address_sanitizer)
+  #define SANITIZED 1
+ #endif
+#elif defined(__SANITIZE_THREAD__) || defined(__SANITIZE_ADDRESS__)
+ #define SANITIZED 1
+#endif
+
+static const char kOutputFileName[] = "stress.log";
+enum {
+    kThreads = 8,
+    kLinesPerThread = 5000,
+    kMaxFileSize = 65536,
+    kMaxBackupFiles = 100,
+    kThroughputLines = 200000,
+    kThroughputFloor = 100000, /* lines/sec, far below any healthy build */
+};
+
+static int s_seen[kThreads][kLinesPerThread];
+static int s_running;
+static pthread_mutex_t s_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static int isRunning(void)
+{
+    int running;
+
+    pthread_mutex_lock(&s_mutex);
+    running = s_running;
+    pthread_mutex_unlock(&s_mutex);
+    return running;
+}
+
+static void setRunning(int running)
+{
+    pthread_mutex_lock(&s_mutex);
+    s_running = running;
+    pthread_mutex_unlock(&s_mutex);
+}
+
+static void removeFiles(void)
+{
+    char name[64];
+    int i;
+
+    remove(kOutputFileName);
+    for (i = 1; i <= kMaxBackupFiles; i++) {
+        sprintf(name, "%s.%d", kOutputFileName, i);
+        remove(name);
+    }
+}
+
+static void* runWorker(void* arg)
+{
+    int worker = *(int*) arg;
+    int i;
+
+    for (i = 0; i < kLinesPerThread; i++) {
+        LOG_WARN("worker=%d line=%d padding=%s", worker, i, "0123456789abcdef");
+    }
+    return NULL;
+}
+
+/* Reconfigure the logger while the workers log */
+static void* runController(void* arg)
+{
+    int i = 0;
+
+    while (isRunning()) {
+        switch (i++ % 4) {
+            case 0:
+                logger_flush();
+                break;
+            case 1:
+                logger_setLevel((i % 8 == 1) ? LogLevel_TRACE : LogLevel_INFO);
+                break;
+            case 2:
+                logger_deduplicate((i % 8 == 2) ? LogSink_FILE : 0);
+                break;
+            case 3:
+                logger_initFileLogger(kOutputFileName, kMaxFileSize, kMaxBackupFiles);
+                break;
+        }
+    }
+    return NULL;
+}
+
+/* Check that every line is whole and written exactly once */
+static int checkLines(void)
+{
+    FILE* fp;
+    char name[64];
+    char line[256];
+    char* p;
+    int i, j, worker, index;
+
+    memset(s_seen, 0, sizeof(s_seen));
+    for (i = 0; i <= kMaxBackupFiles; i++) {
+        if (i == 0) {
+            strcpy(name, kOutputFileName);
+        } else {
+            sprintf(name, "%s.%d", kOutputFileName, i);
+        }
+        if ((fp = fopen(name, "r")) == NULL) {
+            continue;
+        }
+        while (fgets(line, sizeof(line), fp) != NULL) {
+            if (line[0] != 'W' || (p = strstr(line, ": worker=")) == NULL
+                    || sscanf(p, ": worker=%d line=%d", &worker, &index) != 2
+                    || strcmp(&line[strlen(line) - 17], "0123456789abcdef\n") != 0
+                    || worker < 0 || worker >= kThreads || index < 0 || index >= kLinesPerThread) {
+                fprintf(stderr, "torn line in %s: %s", name, line);
+                fclose(fp);
+                return 0;
+            }
+            s_seen[worker][index]++;
+        }
+        fclose(fp);
+    }
+    for (i = 0; i < kThreads; i++) {
+        for (j = 0; j < kLinesPerThread; j++) {
+            if (s_seen[i][j] != 1) {
+                fprintf(stderr, "worker=%d line=%d written %d times\n", i, j, s_seen[i][j]);
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+static int runStress(int reconfigure, int options)
+{
+    pthread_t workers[kThreads], controller;
+    int ids[kThreads];
+    int i;
+
+    removeFiles();
+    if (!logger_initFileLoggerEx(kOutputFileName, kMaxFileSize, kMaxBackupFiles, options)) {
+        return 0;
+    }
+    setRunning(1);
+    if (reconfigure) {
+        pthread_create(&controller, NULL, runController, NULL);
+    }
+    for (i = 0; i < kThreads; i++) {
+        ids[i] = i;
+        pthread_create(&workers[i], NULL, runWorker, &ids[i]);
+    }
+    for (i = 0; i < kThreads; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    setRunning(0);
+    if (reconfigure) {
+        pthread_join(controller, NULL);
+    }
+    logger_exitFileLogger();
+    logger_deduplicate(0);
+    logger_setLevel(LogLevel_INFO);
+    return checkLines();
+}
+
+static int test_rotationStress(void)
+{
+    /* when: many threads log while the files rotate */
+    /* then: no line is lost or torn */
+    nu_assert(runStress(0, 0));
+    return 0;
+}
+
+static int test_reconfigurationStress(void)
+{
+    /* when: many threads log while the logger is flushed, reinitialized and reconfigured */
+    /* then: no line is lost or torn */
+    nu_assert(runStress(1, 0));
+    return 0;
+}
+
+static int test_groupCommitStress(void)
+{
+    /* when: many threads wait for their lines to be synced while the files rotate */
+    /* then: no line is lost or torn */
+    nu_assert(runStress(0, LogFileOption_SYNC_GROUP));
+    return 0;
+}
+
+static int test_throughputFloor(void)
+{
+    struct timespec start, end;
+    double elapsed;
+    int i;
+
+    /* when: log to a file from one thread */
+    removeFiles();
+    nu_assert_eq_int(1, logger_initFileLogger(kOutputFileName, 0x7fffffffL, 0));
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < kThroughputLines; i++) {
+        LOG_INFO("throughput %d", i);
+    }
+    logger_flush();
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    logger_exitFileLogger();
+    elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("    %.0f lines/sec\n", kThroughputLines / elapsed);
+
+    /* then: far more lines than the floor are written per second */
+#if !defined(SANITIZED)
+    nu_assert(kThroughputLines / elapsed >= kThroughputFloor);
+#endif /* !defined(SANITIZED) */
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    nu_run_test(test_rotationStress);
+    nu_run_test(test_reconfigurationStress);
+    nu_run_test(test_groupCommitStress);
+    nu_run_test(test_throughputFloor);
+    removeFiles();
+    nu_report();
+}
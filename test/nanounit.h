@@ -18,7 +18,7 @@ static int nu_failures = 0;
 } while (0)
 
 #define nu_assert(condition) do { \
-    if (!condition) { \
+    if (!(condition)) { \
         nu_fail(); \
     } \
 } while (0)
@@ -0,0 +1,171 @@
+/*
+ * logmerge: Merge log files into one stream ordered by the timestamps of the lines.
+ *
+ * Usage: logmerge FILE...
+ *
+ * Every file must be in timestamp order, as written by the logger, e.g. the files
+ * `<filename>.t<thread ID>` and their backups written with LogFileOption_PER_THREAD.
+ * Lines not starting with the timestamp prefix belong to the line before them.
+ * Lines with the same timestamp keep the order of the files on the command line.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum {
+    kTimestampOffset = 2, /* L yy-MM-dd hh:mm:ss.uuuuuu */
+    kTimestampLen = 24,
+    kInitialLineSize = 1024,
+};
+
+typedef struct {
+    FILE* fp;
+    int index; /* the position on the command line */
+    char* record; /* one line followed by its continuation lines */
+    size_t len, size;
+    char* next; /* the first line of the next record */
+    size_t nextlen, nextsize;
+} Input;
+
+static void* xrealloc(void* ptr, size_t size)
+{
+    if ((ptr = realloc(ptr, size)) == NULL) {
+        fprintf(stderr, "ERROR: logmerge: Out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+    return ptr;
+}
+
+/* Read one whole line including LF. Return its length or 0 at the end of the file. */
+static size_t readLine(FILE* fp, char** buf, size_t* size)
+{
+    size_t len = 0;
+
+    if (*buf == NULL) {
+        *size = kInitialLineSize;
+        *buf = (char*) xrealloc(NULL, *size);
+    }
+    while (fgets(&(*buf)[len], (int) (*size - len), fp) != NULL) {
+        len += strlen(&(*buf)[len]);
+        if ((*buf)[len - 1] == '\n') {
+            break;
+        }
+        *size *= 2;
+        *buf = (char*) xrealloc(*buf, *size);
+    }
+    if (len > 0 && (*buf)[len - 1] != '\n') { /* the last line of a file cut off */
+        (*buf)[len++] = '\n';
+    }
+    return len;
+}
+
+static int isRecordStart(const char* line, size_t len)
+{
+    return len > kTimestampOffset + kTimestampLen
+            && line[1] == ' ' && line[4] == '-' && line[7] == '-' && line[10] == ' '
+            && line[13] == ':' && line[16] == ':' && line[19] == '.' && line[26] == ' ';
+}
+
+static void appendRecord(Input* in, const char* line, size_t len)
+{
+    if (in->len + len > in->size) {
+        in->size = (in->len + len) * 2;
+        in->record = (char*) xrealloc(in->record, in->size);
+    }
+    memcpy(&in->record[in->len], line, len);
+    in->len += len;
+}
+
+/* Read the next record of the input. Return 0 at the end of the file. */
+static int readRecord(Input* in)
+{
+    in->len = 0;
+    if (in->nextlen == 0 && (in->nextlen = readLine(in->fp, &in->next, &in->nextsize)) == 0) {
+        return 0;
+    }
+    appendRecord(in, in->next, in->nextlen);
+    while ((in->nextlen = readLine(in->fp, &in->next, &in->nextsize)) > 0
+            && !isRecordStart(in->next, in->nextlen)) {
+        appendRecord(in, in->next, in->nextlen);
+    }
+    return 1;
+}
+
+static int compareInputs(const Input* a, const Input* b)
+{
+    int result;
+
+    if (isRecordStart(a->record, a->len) && isRecordStart(b->record, b->len)) {
+        result = memcmp(&a->record[kTimestampOffset], &b->record[kTimestampOffset], kTimestampLen);
+        if (result != 0) {
+            return result;
+        }
+    }
+    return a->index - b->index;
+}
+
+/* Move the input at the top of the min-heap down to its place */
+static void siftDown(Input** heap, size_t n, size_t i)
+{
+    Input* tmp;
+    size_t child;
+
+    while ((child = 2 * i + 1) < n) {
+        if (child + 1 < n && compareInputs(heap[child + 1], heap[child]) < 0) {
+            child++;
+        }
+        if (compareInputs(heap[i], heap[child]) <= 0) {
+            break;
+        }
+        tmp = heap[i];
+        heap[i] = heap[child];
+        heap[child] = tmp;
+        i = child;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    Input* inputs;
+    Input** heap;
+    size_t i, n = 0;
+
+    if (argc < 2) {
+        fprintf(stderr, "Usage: logmerge FILE...\n");
+        return EXIT_FAILURE;
+    }
+    inputs = (Input*) calloc(argc - 1, sizeof(Input));
+    heap = (Input**) calloc(argc - 1, sizeof(Input*));
+    if (inputs == NULL || heap == NULL) {
+        fprintf(stderr, "ERROR: logmerge: Out of memory\n");
+        return EXIT_FAILURE;
+    }
+    for (i = 0; i < (size_t) argc - 1; i++) {
+        if ((inputs[i].fp = fopen(argv[i + 1], "r")) == NULL) {
+            fprintf(stderr, "ERROR: logmerge: Failed to open file: `%s`\n", argv[i + 1]);
+            return EXIT_FAILURE;
+        }
+        inputs[i].index = (int) i;
+        if (readRecord(&inputs[i])) {
+            heap[n++] = &inputs[i];
+        }
+    }
+    for (i = n / 2; i > 0; i--) {
+        siftDown(heap, n, i - 1);
+    }
+    while (n > 0) {
+        fwrite(heap[0]->record, 1, heap[0]->len, stdout);
+        if (!readRecord(heap[0])) {
+            heap[0] = heap[--n];
+        }
+        siftDown(heap, n, 0);
+    }
+    for (i = 0; i < (size_t) argc - 1; i++) {
+        fclose(inputs[i].fp);
+        free(inputs[i].record);
+        free(inputs[i].next);
+    }
+    free(inputs);
+    free(heap);
+    return fflush(stdout) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,206 @@
+/*
+ * logquery: Print the lines of a log file and its backups logged in a time range.
+ *
+ * Usage: logquery FILENAME FROM TO
+ *
+ * FROM and TO are local times in the format of the log, `yy-MM-dd hh:mm:ss[.uuuuuu]`.
+ * The backups `<filename>.N` are read from the oldest to `<filename>`. A file with
+ * a time index `<file>.idx` written by logger_indexFile() is only read from the
+ * index entry before FROM to the index entry after TO; the others are read whole.
+ */
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+enum {
+    kTimestampOffset = 2, /* L yy-MM-dd hh:mm:ss.uuuuuu */
+    kTimestampLen = 24,
+    kMaxFileNameLen = 512,
+    kMaxBackupFiles = 255,
+};
+
+static const char kIndexMagic[] = "LOGIDX01";
+
+/* An entry of the time index, see logger_indexFile() */
+typedef struct {
+    unsigned long long time; /* microseconds since the epoch */
+    unsigned long long offset;
+} IndexEntry;
+
+static char s_from[kTimestampLen + 1], s_to[kTimestampLen + 1];
+static unsigned long long s_fromTime, s_toTime;
+
+/* Complete the fraction of a time with the padding digit and convert it to microseconds */
+static int parseTime(const char* arg, char pad, char* timestamp, unsigned long long* micros)
+{
+    struct tm tm;
+    size_t len = strlen(arg);
+    time_t sec;
+
+    memset(&tm, 0, sizeof(tm));
+    if (len < 17 || len > kTimestampLen || (len > 17 && arg[17] != '.')
+            || sscanf(arg, "%2d-%2d-%2d %2d:%2d:%2d", &tm.tm_year, &tm.tm_mon, &tm.tm_mday,
+                    &tm.tm_hour, &tm.tm_min, &tm.tm_sec) != 6) {
+        return 0;
+    }
+    memset(timestamp, pad, kTimestampLen);
+    memcpy(timestamp, arg, len);
+    timestamp[17] = '.';
+    timestamp[kTimestampLen] = '\0';
+    tm.tm_year += 100;
+    tm.tm_mon -= 1;
+    tm.tm_isdst = -1;
+    if ((sec = mktime(&tm)) == (time_t) -1) {
+        return 0;
+    }
+    *micros = (unsigned long long) sec * 1000000 + atol(&timestamp[18]);
+    return 1;
+}
+
+static const char* mapFile(const char* filename, size_t* size)
+{
+    struct stat st;
+    void* addr;
+    int fd;
+
+    if ((fd = open(filename, O_RDONLY)) < 0) {
+        return NULL;
+    }
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return NULL;
+    }
+    addr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        return NULL;
+    }
+    *size = st.st_size;
+    return (const char*) addr;
+}
+
+/* Narrow the range of the file to read down to the index entries around the time range */
+static void searchIndex(const char* filename, size_t* begin, size_t* end)
+{
+    char name[kMaxFileNameLen + 5];
+    const IndexEntry* entries;
+    const char* index;
+    size_t size, n, lo, hi, mid;
+
+    sprintf(name, "%s.idx", filename);
+    if ((index = mapFile(name, &size)) == NULL) {
+        return;
+    }
+    if (size < sizeof(kIndexMagic) - 1 || memcmp(index, kIndexMagic, sizeof(kIndexMagic) - 1) != 0) {
+        fprintf(stderr, "ERROR: logquery: Invalid index: `%s`\n", name);
+        munmap((void*) index, size);
+        return;
+    }
+    entries = (const IndexEntry*) &index[sizeof(kIndexMagic) - 1];
+    n = (size - (sizeof(kIndexMagic) - 1)) / sizeof(IndexEntry);
+
+    /* the last entry before the range */
+    for (lo = 0, hi = n; lo < hi; ) {
+        mid = lo + (hi - lo) / 2;
+        if (entries[mid].time < s_fromTime) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo > 0 && entries[lo - 1].offset < *end) {
+        *begin = (size_t) entries[lo - 1].offset;
+    }
+    /* the first entry after the range */
+    for (hi = n; lo < hi; ) {
+        mid = lo + (hi - lo) / 2;
+        if (entries[mid].time <= s_toTime) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo < n && entries[lo].offset < *end) {
+        *end = (size_t) entries[lo].offset;
+    }
+    munmap((void*) index, size);
+}
+
+static int isRecordStart(const char* line, size_t len)
+{
+    return len > kTimestampOffset + kTimestampLen
+            && line[1] == ' ' && line[4] == '-' && line[7] == '-' && line[10] == ' '
+            && line[13] == ':' && line[16] == ':' && line[19] == '.' && line[26] == ' ';
+}
+
+/* Print the records of the file in the time range. Lines without a timestamp go with their record. */
+static void queryFile(const char* filename)
+{
+    const char* data;
+    const char* line;
+    const char* eol;
+    const char* ts;
+    size_t size, begin = 0, end, len;
+    int printing = 0; /* false */
+
+    if ((data = mapFile(filename, &size)) == NULL) {
+        return;
+    }
+    end = size;
+    searchIndex(filename, &begin, &end);
+    for (line = &data[begin]; line < &data[end]; line = eol) {
+        eol = (const char*) memchr(line, '\n', &data[end] - line);
+        eol = (eol != NULL) ? eol + 1 : &data[end];
+        len = eol - line;
+        if (isRecordStart(line, len)) {
+            ts = &line[kTimestampOffset];
+            printing = memcmp(ts, s_from, kTimestampLen) >= 0 && memcmp(ts, s_to, kTimestampLen) <= 0;
+        }
+        if (printing) {
+            fwrite(line, 1, len, stdout);
+        }
+    }
+    munmap((void*) data, size);
+}
+
+int main(int argc, char* argv[])
+{
+    char name[kMaxFileNameLen + 5];
+    struct stat st;
+    int i, n;
+
+    if (argc != 4) {
+        fprintf(stderr, "Usage: logquery FILENAME FROM TO\n"
+                "  FROM, TO: yy-MM-dd hh:mm:ss[.uuuuuu]\n");
+        return EXIT_FAILURE;
+    }
+    if (strlen(argv[1]) > kMaxFileNameLen) {
+        fprintf(stderr, "ERROR: logquery: Too long filename: `%s`\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+    if (!parseTime(argv[2], '0', s_from, &s_fromTime)) {
+        fprintf(stderr, "ERROR: logquery: Invalid time: `%s`\n", argv[2]);
+        return EXIT_FAILURE;
+    }
+    if (!parseTime(argv[3], '9', s_to, &s_toTime)) {
+        fprintf(stderr, "ERROR: logquery: Invalid time: `%s`\n", argv[3]);
+        return EXIT_FAILURE;
+    }
+    for (n = 0; n < kMaxBackupFiles; n++) {
+        sprintf(name, "%s.%d", argv[1], n + 1);
+        if (stat(name, &st) != 0) {
+            break;
+        }
+    }
+    for (i = n; i > 0; i--) {
+        sprintf(name, "%s.%d", argv[1], i);
+        queryFile(name);
+    }
+    queryFile(argv[1]);
+    return fflush(stdout) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}